@@ -0,0 +1,277 @@
+#include "diff.hpp"
+
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <utility>
+
+#include "utility.hpp"
+
+
+// Returns the string value of `child_key` in a block, or an empty string if there is none.
+static std::string get_value(const VDF::KeyValue & kv, const std::string & child_key)
+{
+	using namespace std;
+	if (holds_alternative<string>(kv.val))
+	{ return ""; }
+	for (const VDF::KeyValue & child : kv.get_vdf())
+	{
+		if (child.key == child_key && holds_alternative<string>(child.val))
+		{ return get<string>(child.val); }
+	}
+	return "";
+}
+
+// Returns the classname of a block, or an empty string if it doesn't have one.
+static std::string get_classname(const VDF::KeyValue & kv)
+{
+	return get_value(kv, "classname");
+}
+
+// Describes a block for messages.
+static std::string describe(const VDF::KeyValue & kv)
+{
+	using namespace std;
+	if (holds_alternative<string>(kv.val))
+	{ return "\"" + get<string>(kv.val) + "\""; }
+	string classname = get_classname(kv);
+	return classname.empty() ? "{...}" : "{classname \"" + classname + "\"}";
+}
+
+
+Differ::Differ(std::unordered_set<std::string> ignore_keys)
+: ignore_keys(std::move(ignore_keys))
+{}
+
+
+[[nodiscard]] std::uint64_t Differ::hash(const VDF::KeyValue & kv)
+{
+	return kv.hash(ignore_keys, &block_hashes);
+}
+
+
+[[nodiscard]] std::vector<Difference> Differ::diff(const VDF & a, const VDF & b)
+{
+	std::vector<Difference> result;
+	diff(a, b, "", "", result);
+	return result;
+}
+
+void Differ::diff(const VDF & a, const VDF & b, const std::string & path_a, const std::string & path_b, std::vector<Difference> & result)
+{
+	using namespace std;
+
+	// A KeyValue that still needs a partner, together with its path.
+	struct Entry
+	{
+		const VDF::KeyValue * kv;
+		string path;
+		bool paired = false;
+		// The KeyValue of the other VDF that this one is compared with, unless they are identical.
+		const Entry * partner = nullptr;
+	};
+
+	// Collects all KeyValues that matter, and gives them paths like "entity[3]".
+	auto collect = [this](const VDF & vdf, const string & path)
+	{
+		vector<Entry> entries;
+		unordered_map<string, size_t> key_counts;
+		for (const VDF::KeyValue & kv : vdf)
+		{
+			if (kv.empty())
+			{ continue; }
+			size_t index = key_counts[kv.key]++;
+			if (contains(ignore_keys, kv.key))
+			{ continue; }
+			entries.push_back(Entry{&kv, path + kv.key + "[" + to_string(index) + "]"});
+		}
+		return entries;
+	};
+
+	vector<Entry> entries_a = collect(a, path_a);
+	vector<Entry> entries_b = collect(b, path_b);
+
+	// First, pair up everything that is identical. Identical KeyValues have identical hashes.
+	// Copies of the same KeyValue (like brushes that were copied and pasted) share a hash, and are handed out in order.
+	struct Candidates
+	{
+		vector<size_t> indices;
+		size_t next = 0;
+	};
+	unordered_map<uint64_t, Candidates> hashes_b;
+	hashes_b.reserve(entries_b.size());
+	for (size_t i = 0; i < entries_b.size(); ++i)
+	{ hashes_b[hash(*entries_b[i].kv)].indices.push_back(i); }
+
+	for (Entry & entry_a : entries_a)
+	{
+		auto search = hashes_b.find(hash(*entry_a.kv));
+		if (search == hashes_b.end() || search->second.next >= search->second.indices.size())
+		{ continue; }
+		Entry & entry_b = entries_b[search->second.indices[search->second.next]];
+		// The key is part of the hash, so this only fails if two different KeyValues have the same hash by accident.
+		if (entry_b.kv->key == entry_a.kv->key)
+		{
+			entry_a.paired = entry_b.paired = true;
+			search->second.next += 1;
+		}
+	}
+
+	// Everything left over is different. Two leftovers are only looked at more closely if they are the same thing in both
+	// VDFs, because comparing unrelated blocks (like two different brushes) only lists meaningless differences.
+	// Blocks are the same thing if they have the same key and classname, and also the same "id" or "targetname" (unless
+	// that key is ignored, like "id" usually is), or if they have children in common. Blocks with nothing in common are only
+	// paired up if they are the only leftover block of their kind on both sides, like "editor".
+	// Strings are paired up by key, in order. Everything that has no partner was added or removed.
+	auto pair_up = [&entries_a, &entries_b](auto identity, bool only_unique)
+	{
+		map<tuple<string, string, string>, pair<vector<Entry *>, vector<Entry *>>> groups;
+		auto add_to_groups = [&groups, &identity, only_unique](vector<Entry> & entries, bool is_a)
+		{
+			for (Entry & entry : entries)
+			{
+				if (entry.paired)
+				{ continue; }
+				string id = identity(*entry.kv);
+				if (id.empty() && !only_unique)
+				{ continue; }
+				auto & group = groups[{entry.kv->key, get_classname(*entry.kv), id}];
+				(is_a ? group.first : group.second).push_back(&entry);
+			}
+		};
+		add_to_groups(entries_a, true);
+		add_to_groups(entries_b, false);
+
+		for (auto & [group_key, group] : groups)
+		{
+			if (only_unique && (group.first.size() != 1 || group.second.size() != 1))
+			{ continue; }
+			for (size_t i = 0; i < group.first.size() && i < group.second.size(); ++i)
+			{
+				group.first[i]->paired = group.second[i]->paired = true;
+				group.first[i]->partner = group.second[i];
+			}
+		}
+	};
+
+	// Pairs up leftover blocks of the same kind that share the most children, best matches first.
+	auto pair_similar = [this, &entries_a, &entries_b]()
+	{
+		// A child that lots of blocks have (like a common material) doesn't tell them apart, and would make this quadratic.
+		constexpr size_t max_owners = 8;
+
+		// The hashes of the children of a block, sorted and without duplicates.
+		// The classname is left out, because every block in a group has the same one.
+		auto child_hashes = [this](const Entry & entry)
+		{
+			vector<uint64_t> hashes;
+			for (const VDF::KeyValue & child : entry.kv->get_vdf())
+			{
+				if (!child.empty() && !contains(ignore_keys, child.key) && child.key != "classname")
+				{ hashes.push_back(hash(child)); }
+			}
+			sort(hashes.begin(), hashes.end());
+			hashes.erase(unique(hashes.begin(), hashes.end()), hashes.end());
+			return hashes;
+		};
+
+		map<pair<string, string>, pair<vector<Entry *>, vector<Entry *>>> groups;
+		for (Entry & entry : entries_a)
+		{
+			if (!entry.paired && !holds_alternative<string>(entry.kv->val))
+			{ groups[{entry.kv->key, get_classname(*entry.kv)}].first.push_back(&entry); }
+		}
+		for (Entry & entry : entries_b)
+		{
+			if (!entry.paired && !holds_alternative<string>(entry.kv->val))
+			{ groups[{entry.kv->key, get_classname(*entry.kv)}].second.push_back(&entry); }
+		}
+
+		for (auto & [group_key, group] : groups)
+		{
+			if (group.first.empty() || group.second.empty())
+			{ continue; }
+
+			// Which blocks of `b` have each child.
+			unordered_map<uint64_t, vector<size_t>> owners;
+			for (size_t j = 0; j < group.second.size(); ++j)
+			{
+				for (uint64_t child_hash : child_hashes(*group.second[j]))
+				{ owners[child_hash].push_back(j); }
+			}
+
+			struct Match
+			{
+				size_t shared;
+				size_t i;
+				size_t j;
+			};
+			vector<Match> matches;
+			for (size_t i = 0; i < group.first.size(); ++i)
+			{
+				unordered_map<size_t, size_t> shared;
+				for (uint64_t child_hash : child_hashes(*group.first[i]))
+				{
+					auto search = owners.find(child_hash);
+					if (search == owners.end() || search->second.size() > max_owners)
+					{ continue; }
+					for (size_t j : search->second)
+					{ shared[j] += 1; }
+				}
+				for (const auto & [j, count] : shared)
+				{ matches.push_back(Match{count, i, j}); }
+			}
+			sort(matches.begin(), matches.end(), [](const Match & x, const Match & y)
+			{ return tie(y.shared, x.i, x.j) < tie(x.shared, y.i, y.j); });
+
+			for (const Match & match : matches)
+			{
+				Entry & entry_a = *group.first[match.i];
+				Entry & entry_b = *group.second[match.j];
+				if (entry_a.paired || entry_b.paired)
+				{ continue; }
+				entry_a.paired = entry_b.paired = true;
+				entry_a.partner = &entry_b;
+			}
+		}
+	};
+
+	// Ignored keys can't identify anything. Hammer renumbers ids, so "id" is usually one of them.
+	for (const string & identity_key : {string("id"), string("targetname")})
+	{
+		if (!contains(ignore_keys, identity_key))
+		{ pair_up([&identity_key](const VDF::KeyValue & kv) { return get_value(kv, identity_key); }, false); }
+	}
+	pair_up([](const VDF::KeyValue & kv) { return string(holds_alternative<string>(kv.val) ? "string" : ""); }, false);
+	pair_similar();
+	pair_up([](const VDF::KeyValue &) { return string(); }, true);
+
+	for (Entry & entry_a : entries_a)
+	{
+		if (entry_a.paired && entry_a.partner == nullptr) // identical
+		{ continue; }
+		if (entry_a.partner == nullptr)
+		{
+			result.push_back(Difference{Difference::Kind::Removed, entry_a.path, describe(*entry_a.kv)});
+			continue;
+		}
+
+		const VDF::KeyValue & kv_a = *entry_a.kv;
+		const VDF::KeyValue & kv_b = *entry_a.partner->kv;
+		if (holds_alternative<string>(kv_a.val) || holds_alternative<string>(kv_b.val))
+		{
+			result.push_back(Difference{Difference::Kind::Modified, entry_a.path, describe(kv_a) + " -> " + describe(kv_b)});
+		}
+		else
+		{
+			// Added KeyValues get paths in the new VDF, everything else in the old one.
+			diff(kv_a.get_vdf(), kv_b.get_vdf(), entry_a.path + "/", entry_a.partner->path + "/", result);
+		}
+	}
+
+	for (Entry & entry_b : entries_b)
+	{
+		if (!entry_b.paired)
+		{ result.push_back(Difference{Difference::Kind::Added, entry_b.path, describe(*entry_b.kv)}); }
+	}
+}
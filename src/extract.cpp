@@ -0,0 +1,226 @@
+#include "extract.hpp"
+
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <system_error> // error_code
+#include <istream>
+#include <ostream>
+
+#include "utility.hpp"
+
+
+// Returns the classname of an entity, or an empty string if it doesn't have one.
+// The result refers to the string inside of `entity`, so nothing is copied.
+static const std::string & get_classname(const VDF & entity)
+{
+	using namespace std;
+	static const string no_classname;
+	for (const VDF::KeyValue & ent_kv : entity)
+	{
+		if (ent_kv.key == "classname" && holds_alternative<string>(ent_kv.val))
+		{ return get<string>(ent_kv.val); }
+	}
+	return no_classname;
+}
+
+
+Extractor::Extractor(const Profile & profile)
+: profile(profile)
+{
+	for (const Profile::ClassOrigin & class_origin : profile.class_origins)
+	{ next_origins.push_back(class_origin.origin); }
+}
+
+
+bool Extractor::process(VDF::KeyValue & kv)
+{
+	if (kv.key == "entity")
+	{
+		return process_entity(kv);
+	}
+	else if (kv.key == "world" && profile.keep_world)
+	{
+		kv.edit_vdf().retain([this](const VDF::KeyValue & world_kv) { return profile.keeps_in_world(world_kv.key); });
+		return true;
+	}
+	return false;
+}
+
+
+[[nodiscard]] bool Extractor::wants_block(const std::vector<std::string> & parents, const std::string & key) const
+{
+	if (parents.empty())
+	{ return key == "entity" || (key == "world" && profile.keep_world); }
+	if (parents.size() == 1 && parents[0] == "world")
+	{ return profile.keep_world && profile.keeps_in_world(key); }
+	return true;
+}
+
+
+bool Extractor::process_entity(VDF::KeyValue & kv)
+{
+	using namespace std;
+
+	const VDF & entity = kv.get_vdf();
+	int class_index = -1;
+
+	if (!profile.match_classname(get_classname(entity), class_index))
+	{ return false; }
+
+	// Equal entities have equal hashes. Different entities only have equal hashes by (very unlikely) accident.
+	std::uint64_t entity_hash = 0;
+	if (profile.dedup)
+	{
+		entity_hash = entity.hash(profile.dedup_ignore_keys, nullptr);
+		if (contains(kept_hashes, entity_hash))
+		{ return false; }
+	}
+
+	if (class_index != -1 && profile.class_origins[class_index].has_origin)
+	{
+		Profile::Pos3D & origin = next_origins[class_index];
+		for (VDF::KeyValue & ent_kv : kv.edit_vdf())
+		{
+			if (ent_kv.key == "origin")
+			{
+				ent_kv.val = origin.to_string();
+				origin.x += profile.origin_step.x;
+				origin.y += profile.origin_step.y;
+				origin.z += profile.origin_step.z;
+				break;
+			}
+		}
+	}
+
+	if (profile.dedup)
+	{ kept_hashes.insert(entity_hash); }
+	return true;
+}
+
+
+[[nodiscard]] VDF extract(const VDF & vmf, const Profile & profile)
+{
+	Extractor extractor {profile};
+
+	// Shallow copy. Nested blocks are still shared with `vmf` until we edit them.
+	VDF result = vmf;
+
+	result.retain([&extractor](VDF::KeyValue & vmf_kv) { return extractor.process(vmf_kv); });
+
+	return result;
+}
+
+
+std::vector<ExtractionStats> extract_stream(std::istream & input, const std::vector<const Profile *> & profiles, const std::vector<std::ostream *> & outputs)
+{
+	using namespace std;
+	vector<ExtractionStats> stats (profiles.size());
+	vector<Extractor> extractors;
+	extractors.reserve(profiles.size());
+	for (const Profile * profile : profiles)
+	{ extractors.emplace_back(*profile); }
+
+	// A block is only thrown away if no profile wants it.
+	auto filter = [&extractors, &stats](const vector<string> & parents, const string & key)
+	{
+		if (parents.empty())
+		{
+			for (ExtractionStats & s : stats)
+			{ s.blocks += 1; }
+		}
+		for (const Extractor & extractor : extractors)
+		{
+			if (extractor.wants_block(parents, key))
+			{ return true; }
+		}
+		return false;
+	};
+
+	VDF::StreamParser parser {[&](VDF::KeyValue && kv)
+	{
+		// KeyValues at the outermost level that aren't blocks haven't been counted by the filter.
+		bool is_block = !holds_alternative<string>(kv.val);
+		for (size_t i = 0; i < extractors.size(); ++i)
+		{
+			if (!is_block)
+			{ stats[i].blocks += 1; }
+			// Shallow copy, so that the edits of one profile don't show up in the others.
+			VDF::KeyValue copy = kv;
+			if (extractors[i].process(copy))
+			{
+				stats[i].kept_blocks += 1;
+				VDF::serialize_to_stream(*outputs[i], copy);
+			}
+		}
+	}, filter};
+
+	vector<char> buffer (64 * 1024);
+	while (input.read(buffer.data(), buffer.size()) || input.gcount() > 0)
+	{
+		size_t size = static_cast<size_t>(input.gcount());
+		for (ExtractionStats & s : stats)
+		{ s.input_bytes += size; }
+		parser.feed(buffer.data(), size);
+	}
+	parser.finish();
+
+	for (ostream * output : outputs)
+	{ output->flush(); }
+	return stats;
+}
+
+
+std::vector<ExtractionStats> extract_file(const std::string & input_filepath, const std::vector<const Profile *> & profiles, const std::vector<std::string> & output_filepaths)
+{
+	using namespace std;
+	ifstream input {input_filepath};
+	input.exceptions(ios_base::badbit);
+	if (!input)
+	{ throw runtime_error("Could not open \"" + input_filepath + "\""); }
+
+	vector<string> temp_filepaths;
+	vector<ofstream> outfiles;
+	vector<ostream *> outputs;
+	outfiles.reserve(output_filepaths.size());
+	try
+	{
+		for (const string & output_filepath : output_filepaths)
+		{
+			temp_filepaths.push_back(output_filepath + ".tmp");
+			outfiles.emplace_back(temp_filepaths.back());
+			if (!outfiles.back())
+			{ throw runtime_error("Could not open \"" + temp_filepaths.back() + "\" for writing"); }
+			outfiles.back().exceptions(ios_base::failbit);
+			outputs.push_back(&outfiles.back());
+		}
+
+		// Blocks that aren't kept (like all the brushes) are thrown away without ever being parsed.
+		vector<ExtractionStats> stats = extract_stream(input, profiles, outputs);
+
+		for (ofstream & outfile : outfiles)
+		{ outfile.close(); }
+		for (size_t i = 0; i < output_filepaths.size(); ++i)
+		{ filesystem::rename(temp_filepaths[i], output_filepaths[i]); }
+		return stats;
+	}
+	catch (...)
+	{
+		for (ofstream & outfile : outfiles)
+		{
+			outfile.exceptions(ios_base::goodbit); // closing a broken file must not throw again
+			outfile.close();
+		}
+		for (const string & temp_filepath : temp_filepaths)
+		{
+			error_code ignored;
+			filesystem::remove(temp_filepath, ignored);
+		}
+		throw;
+	}
+}
+
+ExtractionStats extract_file(const std::string & input_filepath, const std::string & output_filepath, const Profile & profile)
+{
+	return extract_file(input_filepath, {&profile}, {output_filepath})[0];
+}
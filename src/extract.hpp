@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_set>
+#include <iosfwd> // istream, ostream
+
+#include "vdf.hpp"
+#include "profile.hpp"
+
+
+// Decides for every block at the outermost level of a VMF whether it is kept, and edits the kept ones, following a `Profile`.
+// Blocks are handed over one after another, in the same order as in the VMF.
+// This means the extractor also works while a VMF is still being read. (See `VDF::StreamParser`)
+class Extractor
+{
+public:
+	// The profile must stay alive for as long as the extractor is used.
+	explicit Extractor(const Profile & profile);
+
+	// Returns `false` if the block should be thrown away.
+	// Kept blocks may be edited, but only through `KeyValue::edit_vdf()`, so that other copies of the VMF are left alone.
+	bool process(VDF::KeyValue & kv);
+
+	// Returns `false` if a block can be thrown away before it's parsed, because `process()` would never look at it.
+	// `parents` are the keys of the blocks around it, outermost first. (See `VDF::StreamParser::BlockFilter`)
+	[[nodiscard]] bool wants_block(const std::vector<std::string> & parents, const std::string & key) const;
+
+private:
+	const Profile & profile;
+	// The origin that the next entity of each class in `profile.classnames` will get.
+	std::vector<Profile::Pos3D> next_origins;
+	// Hashes of all entities that were kept so far. Used to find duplicates, without keeping the entities themselves around.
+	std::unordered_set<std::uint64_t> kept_hashes;
+
+	bool process_entity(VDF::KeyValue & kv);
+};
+
+
+// Derives a new VMF from an already parsed one, using an `Extractor`.
+// The input is never changed, and every block that isn't edited stays shared between the input and the result.
+// This means one parsed VMF can be used to create several variants without parsing it again.
+[[nodiscard]] VDF extract(const VDF & vmf, const Profile & profile);
+
+
+// Numbers about a single extraction, for messages.
+struct ExtractionStats
+{
+	// Size of the input file in bytes.
+	std::size_t input_bytes = 0;
+	// Number of blocks at the outermost level of the input, and how many of them were kept.
+	std::size_t blocks = 0;
+	std::size_t kept_blocks = 0;
+};
+
+// Reads a VMF from `input` and extracts it with every profile at once, writing the result of `profiles[i]` to `outputs[i]`.
+// Every block is written as soon as it has been read, and blocks that no profile wants are never parsed.
+// This means only one block is in memory at a time, no matter how big the VMF is.
+// Returns one `ExtractionStats` per profile. `input_bytes` is the number of bytes read from `input`.
+// May throw exceptions. (Malformed VDF text)
+std::vector<ExtractionStats> extract_stream(std::istream & input, const std::vector<const Profile *> & profiles, const std::vector<std::ostream *> & outputs);
+
+// Reads the VMF at `input_filepath` once and extracts it with every profile, writing the result of `profiles[i]` to `output_filepaths[i]`.
+// Every output is first written to "<path>.tmp" and only renamed once the whole VMF has been read. If anything goes wrong,
+// the temporary files are deleted again, so a broken VMF never replaces a good output from an earlier run.
+// May throw exceptions. (File reading/writing errors, malformed VDF text)
+std::vector<ExtractionStats> extract_file(const std::string & input_filepath, const std::vector<const Profile *> & profiles, const std::vector<std::string> & output_filepaths);
+
+// Same as above, for a single profile.
+ExtractionStats extract_file(const std::string & input_filepath, const std::string & output_filepath, const Profile & profile);
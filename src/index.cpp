@@ -0,0 +1,351 @@
+#include "index.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "vdf.hpp"
+#include "utility.hpp"
+
+
+// Every index file starts with this, followed by a version number.
+static const char index_magic[8] = {'V', 'M', 'F', 'I', 'N', 'D', 'E', 'X'};
+// Version 2 stores canonical paths, so the same file is recognized no matter how the folder was spelled.
+static const std::uint32_t index_version = 2;
+
+// Keys that are different for (nearly) every entity. Indexing them would only make the index bigger.
+static const std::unordered_set<std::string> unindexed_keys {"id", "origin", "angles"};
+
+
+//// binary file helpers ////
+
+
+// Numbers are stored in 7 bits per byte, so small numbers only take a single byte. (LEB128)
+static void write_varint(std::string & out, std::uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		out += static_cast<char>((value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	out += static_cast<char>(value);
+}
+
+static void write_string(std::string & out, const std::string & s)
+{
+	write_varint(out, s.size());
+	out += s;
+}
+
+// Reads the binary content of an index file, keeping track of the position.
+class IndexReader
+{
+public:
+	explicit IndexReader(const std::string & data)
+	: data(data)
+	{}
+
+	std::uint64_t read_varint()
+	{
+		std::uint64_t value = 0;
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			std::uint8_t byte = static_cast<std::uint8_t>(read_bytes(1)[0]);
+			value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+			{ return value; }
+		}
+		throw std::runtime_error("The index file is damaged! (Number too long)");
+	}
+
+	std::string read_string()
+	{
+		std::size_t size = read_varint();
+		return std::string(read_bytes(size), size);
+	}
+
+	const char * read_bytes(std::size_t size)
+	{
+		if (size > data.size() - position)
+		{ throw std::runtime_error("The index file is damaged! (Ends too early)"); }
+		const char * result = data.data() + position;
+		position += size;
+		return result;
+	}
+
+private:
+	const std::string & data;
+	std::size_t position = 0;
+};
+
+
+//// EntityIndex ////
+
+
+EntityIndex EntityIndex::load(const std::string & filepath)
+{
+	using namespace std;
+	EntityIndex index;
+	if (!filesystem::exists(filepath))
+	{ return index; }
+
+	ifstream infile {filepath, ios::binary};
+	infile.exceptions(ios_base::failbit | ios_base::badbit);
+	ostringstream content;
+	content << infile.rdbuf();
+	const string data = content.str();
+
+	IndexReader reader {data};
+	if (data.compare(0, sizeof(index_magic), index_magic, sizeof(index_magic)) != 0)
+	{ throw runtime_error("\"" + filepath + "\" is not an index file!"); }
+	reader.read_bytes(sizeof(index_magic));
+	if (reader.read_varint() != index_version)
+	{ throw runtime_error("\"" + filepath + "\" was made by a different version of this program! Delete it and make a new one."); }
+
+	index.files.resize(reader.read_varint());
+	for (File & file : index.files)
+	{
+		file.path = reader.read_string();
+		file.mtime = static_cast<int64_t>(reader.read_varint());
+		file.size = reader.read_varint();
+	}
+
+	size_t term_count = reader.read_varint();
+	for (size_t t = 0; t < term_count; ++t)
+	{
+		string term = reader.read_string();
+		vector<Posting> & list = index.postings[move(term)];
+		list.resize(reader.read_varint());
+		// Files are stored as the difference to the previous posting, and so are entities within the same file.
+		Posting previous {0, 0};
+		for (Posting & posting : list)
+		{
+			uint32_t file_delta = static_cast<uint32_t>(reader.read_varint());
+			uint32_t entity = static_cast<uint32_t>(reader.read_varint());
+			posting.file = previous.file + file_delta;
+			posting.entity = (file_delta == 0) ? previous.entity + entity : entity;
+			if (posting.file >= index.files.size())
+			{ throw runtime_error("The index file is damaged! (Unknown file)"); }
+			previous = posting;
+		}
+	}
+
+	return index;
+}
+
+
+void EntityIndex::save(const std::string & filepath) const
+{
+	using namespace std;
+	string out;
+	out.append(index_magic, sizeof(index_magic));
+	write_varint(out, index_version);
+
+	// Removed files are left out, so the remaining ones get new ids. Their order stays the same, so postings stay sorted.
+	vector<uint32_t> new_ids (files.size());
+	uint32_t alive_count = 0;
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		if (files[i].alive)
+		{ new_ids[i] = alive_count++; }
+	}
+
+	write_varint(out, alive_count);
+	for (const File & file : files)
+	{
+		if (!file.alive)
+		{ continue; }
+		write_string(out, file.path);
+		write_varint(out, static_cast<uint64_t>(file.mtime));
+		write_varint(out, file.size);
+	}
+
+	write_varint(out, postings.size());
+	for (const auto & [term, list] : postings)
+	{
+		write_string(out, term);
+		write_varint(out, list.size());
+		Posting previous {0, 0};
+		for (const Posting & posting : list)
+		{
+			Posting current {new_ids[posting.file], posting.entity};
+			uint32_t file_delta = current.file - previous.file;
+			write_varint(out, file_delta);
+			write_varint(out, (file_delta == 0) ? current.entity - previous.entity : current.entity);
+			previous = current;
+		}
+	}
+
+	ofstream outfile {filepath, ios::binary};
+	outfile.exceptions(ios_base::failbit);
+	outfile.write(out.data(), out.size());
+	outfile.close();
+}
+
+
+std::size_t EntityIndex::update(const std::string & folder, std::ostream & console)
+{
+	using namespace std;
+
+	// Find every VMF, and remember what it looks like right now.
+	struct Found
+	{
+		int64_t mtime;
+		uint64_t size;
+	};
+	unordered_map<string, Found> found;
+	// Paths start with the canonical folder. Otherwise "maps" and "./maps" would look like different files.
+	const string root = filesystem::canonical(folder).string();
+	// Folders that can't be opened are skipped instead of stopping the whole update.
+	for (const auto & entry : filesystem::recursive_directory_iterator(root, filesystem::directory_options::skip_permission_denied))
+	{
+		if (!entry.is_regular_file() || !string_ends_with(entry.path().string(), ".vmf"))
+		{ continue; }
+		found[entry.path().string()] = Found{
+			static_cast<int64_t>(entry.last_write_time().time_since_epoch().count()),
+			static_cast<uint64_t>(entry.file_size()),
+		};
+	}
+
+	// Returns `true` if `path` is somewhere inside of `root`.
+	auto is_inside_root = [&root](const string & path)
+	{
+		const char separator = static_cast<char>(filesystem::path::preferred_separator);
+		return path.size() > root.size() && path.compare(0, root.size(), root) == 0
+		&& (path[root.size()] == separator || root.back() == separator);
+	};
+
+	// Remove the files that changed or are gone. They are removed from all postings at once.
+	// Files outside of `folder` weren't looked at, so they stay as they are. (One index can cover several folders.)
+	unordered_set<uint32_t> removed;
+	for (uint32_t i = 0; i < files.size(); ++i)
+	{
+		File & file = files[i];
+		if (!file.alive || !is_inside_root(file.path))
+		{ continue; }
+		auto search = found.find(file.path);
+		if (search != found.end() && search->second.mtime == file.mtime && search->second.size == file.size)
+		{
+			found.erase(search); // unchanged, nothing to do
+			continue;
+		}
+		file.alive = false;
+		removed.insert(i);
+	}
+
+	if (!removed.empty())
+	{
+		for (auto it = postings.begin(); it != postings.end(); )
+		{
+			vector<Posting> & list = it->second;
+			list.erase(remove_if(list.begin(), list.end(), [&removed](const Posting & p){ return contains(removed, p.file); }), list.end());
+			it = list.empty() ? postings.erase(it) : next(it);
+		}
+	}
+
+	// Everything left in `found` is new or changed. Sorted, so the order doesn't depend on the file system.
+	vector<string> paths;
+	for (const auto & [path, info] : found)
+	{ paths.push_back(path); }
+	sort(paths.begin(), paths.end());
+
+	size_t read_count = 0;
+	for (const string & path : paths)
+	{
+		console << "Indexing \"" << path << "\"" << endl;
+		try
+		{
+			add_file(path, found[path].mtime, found[path].size);
+			read_count += 1;
+		}
+		catch (const std::exception & e)
+		{
+			console << "WARNING: Could not read \"" << path << "\"! Skipping. (" << e.what() << ")" << endl;
+		}
+	}
+	return read_count;
+}
+
+
+void EntityIndex::add_file(const std::string & path, std::int64_t mtime, std::uint64_t size)
+{
+	using namespace std;
+	// Lazy, because only the keys directly inside of entities and the world are needed. Brushes are never parsed.
+	VDF vmf = VDF::parse_from_filepath_lazy(path);
+
+	// New files always get the highest id, so adding their postings at the end keeps every list sorted.
+	const uint32_t file_id = static_cast<uint32_t>(files.size());
+	uint32_t entity_id = 0;
+	vector<pair<string, Posting>> new_postings;
+
+	for (const VDF::KeyValue & vmf_kv : vmf)
+	{
+		if ((vmf_kv.key != "entity" && vmf_kv.key != "world") || holds_alternative<string>(vmf_kv.val))
+		{ continue; }
+
+		for (const VDF::KeyValue & ent_kv : vmf_kv.get_vdf())
+		{
+			if (holds_alternative<string>(ent_kv.val) && !contains(unindexed_keys, ent_kv.key))
+			{ new_postings.emplace_back(ent_kv.key + "=" + get<string>(ent_kv.val), Posting{file_id, entity_id}); }
+		}
+		entity_id += 1;
+	}
+
+	// Only change the index once the whole file was read without errors.
+	files.push_back(File{path, mtime, size, true});
+	for (auto & [term, posting] : new_postings)
+	{
+		vector<Posting> & list = postings[term];
+		// An entity with the same key twice shouldn't be listed twice.
+		if (list.empty() || !(list.back() == posting))
+		{ list.push_back(posting); }
+	}
+}
+
+
+[[nodiscard]] std::vector<std::pair<std::string, std::size_t>> EntityIndex::query(const std::vector<std::string> & terms) const
+{
+	using namespace std;
+	vector<pair<string, size_t>> result;
+	if (terms.empty())
+	{ return result; }
+
+	// Look up every term. Starting with the shortest list keeps the intersection cheap.
+	vector<const vector<Posting> *> lists;
+	for (const string & term : terms)
+	{
+		auto search = postings.find(term.find('=') == string::npos ? "classname=" + term : term);
+		if (search == postings.end())
+		{ return result; }
+		lists.push_back(&search->second);
+	}
+	sort(lists.begin(), lists.end(), [](auto a, auto b){ return a->size() < b->size(); });
+
+	vector<Posting> matches = *lists[0];
+	for (size_t i = 1; i < lists.size() && !matches.empty(); ++i)
+	{
+		vector<Posting> intersection;
+		set_intersection(matches.begin(), matches.end(), lists[i]->begin(), lists[i]->end(), back_inserter(intersection));
+		matches = move(intersection);
+	}
+
+	for (const Posting & posting : matches)
+	{
+		const string & path = files[posting.file].path;
+		if (result.empty() || result.back().first != path)
+		{ result.emplace_back(path, 0); }
+		result.back().second += 1;
+	}
+	return result;
+}
+
+
+[[nodiscard]] std::size_t EntityIndex::file_count() const noexcept
+{
+	return static_cast<std::size_t>(std::count_if(files.begin(), files.end(), [](const File & f){ return f.alive; }));
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd> // ostream
+#include <map>
+#include <string>
+#include <utility> // pair
+#include <vector>
+
+
+// Remembers which entities of many VMFs have which key/value pairs, so that questions like
+// "which maps have an env_fog_controller with fogenable 1" can be answered without reading a single VMF.
+// For every "key=value" pair, the index stores a list of every entity that has it. (Postings list)
+// The world counts as an entity too, so its keys (like skyname) can be searched as well.
+// The index is saved in a compact binary file and only needs to re-read VMFs that changed since the last update.
+class EntityIndex
+{
+public:
+	// Loads an index file. Returns an empty index if the file doesn't exist yet.
+	// May throw exceptions. (File reading errors or a file that isn't an index)
+	static EntityIndex load(const std::string & filepath);
+
+	// Writes the index to a file.
+	// May throw exceptions. (File writing/creation errors)
+	void save(const std::string & filepath) const;
+
+	// Brings the index up to date with every VMF in `folder` and its subfolders.
+	// Only new and changed VMFs are read, and VMFs that are gone are removed from the index.
+	// VMFs that can't be read are skipped with a warning, and tried again in the next update.
+	// Returns the number of VMFs that were read.
+	std::size_t update(const std::string & folder, std::ostream & console);
+
+	// Finds every entity that has all of the given "key=value" pairs. A term without "=" is a classname.
+	// Returns the path of every VMF with at least one such entity, together with the number of matching entities.
+	[[nodiscard]] std::vector<std::pair<std::string, std::size_t>> query(const std::vector<std::string> & terms) const;
+
+	[[nodiscard]] std::size_t file_count() const noexcept;
+	[[nodiscard]] std::size_t term_count() const noexcept { return postings.size(); }
+
+private:
+	struct File
+	{
+		std::string path;
+		// Used to notice changes. If either is different, the VMF is read again.
+		std::int64_t mtime = 0;
+		std::uint64_t size = 0;
+		// `false` if the VMF was removed from the index. Its id isn't reused until the index is saved.
+		bool alive = true;
+	};
+
+	// One entity in one VMF. Sorted by file first.
+	struct Posting
+	{
+		std::uint32_t file;
+		std::uint32_t entity;
+
+		bool operator<(const Posting & other) const noexcept
+		{ return (file != other.file) ? (file < other.file) : (entity < other.entity); }
+		bool operator==(const Posting & other) const noexcept
+		{ return file == other.file && entity == other.entity; }
+	};
+
+	std::vector<File> files;
+	// "key=value" -> every entity that has it, sorted.
+	std::map<std::string, std::vector<Posting>> postings;
+
+	// Reads a VMF and adds all of its entities to the index.
+	void add_file(const std::string & path, std::int64_t mtime, std::uint64_t size);
+};
@@ -3,146 +3,279 @@
 #include <vector>
 #include <string>
 #include <sstream>
-#include <map>
+#include <thread>
+#include <filesystem>
+#include <unordered_set>
+#include <stdexcept> // runtime_error
 
 #include "vdf.hpp"
+#include "extract.hpp"
+#include "profile.hpp"
+#include "server.hpp"
+#include "diff.hpp"
+#include "index.hpp"
+#include "region.hpp"
 #include "utility.hpp"
 
 
 int main(int argc, char* argv[])
 {
 	using namespace std;
-	cout << "Program Version Date: " __DATE__ " " __TIME__ << endl;
-	cout << "Drag and drop one or multiple VMF files to process them. Folders are not supported." << endl;
+
+	// "-" reads a VMF from stdin and writes to stdout. Messages go to stderr then, so they don't end up in the output.
+	bool pipe_mode = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (string(argv[i]) == "-")
+		{ pipe_mode = true; }
+	}
+	ostream & console = pipe_mode ? cerr : cout;
+
+	console << "Program Version Date: " __DATE__ " " __TIME__ << endl;
+	console << "Drag and drop one or multiple VMF files to process them. Folders are not supported." << endl;
 	try
 	{
 		if (argc <= 1)
 		{ throw "No input!"; }
 
+		// "diff <old> <new> [--ignore <key>]..." lists what changed between two VMFs.
+		if (string(argv[1]) == "diff")
+		{
+			if (argc < 4)
+			{ throw "Usage: diff <old path> <new path> [--ignore <key>]..."; }
+			// Hammer renumbers ids and changes editor blocks all the time, which isn't interesting.
+			unordered_set<string> ignore_keys {"id", "editor"};
+			for (int i = 4; i < argc; i += 2)
+			{
+				if (string(argv[i]) != "--ignore" || i+1 >= argc)
+				{ throw "Usage: diff <old path> <new path> [--ignore <key>]..."; }
+				ignore_keys.insert(argv[i+1]);
+			}
+
+			console << "Reading Files..." << endl;
+			VDF old_vmf = VDF::parse_from_filepath(argv[2]);
+			VDF new_vmf = VDF::parse_from_filepath(argv[3]);
+
+			console << "Comparing..." << endl;
+			Differ differ {ignore_keys};
+			vector<Difference> differences = differ.diff(old_vmf, new_vmf);
+			for (const Difference & difference : differences)
+			{
+				switch (difference.kind)
+				{
+				case Difference::Kind::Added:    console << "+ "; break;
+				case Difference::Kind::Removed:  console << "- "; break;
+				case Difference::Kind::Modified: console << "~ "; break;
+				}
+				console << difference.path << " " << difference.detail << endl;
+			}
+			console << differences.size() << " Differences Found." << endl;
+			return 0;
+		}
+
+		// "index <folder> <index path>" creates or updates an index of every entity in every VMF in a folder.
+		if (string(argv[1]) == "index")
+		{
+			if (argc != 4)
+			{ throw "Usage: index <folder> <index path>"; }
+			console << "Loading Index..." << endl;
+			EntityIndex index = EntityIndex::load(argv[3]);
+			size_t read_count = index.update(argv[2], console);
+			console << "Writing Index..." << endl;
+			index.save(argv[3]);
+			console << "Read " << read_count << " VMFs. The index now has " << index.file_count() << " VMFs and " << index.term_count() << " key/value pairs." << endl;
+			return 0;
+		}
+
+		// "query <index path> <classname or key=value>..." lists every VMF with an entity that has all of the given key/value pairs.
+		if (string(argv[1]) == "query")
+		{
+			if (argc < 4)
+			{ throw "Usage: query <index path> <classname or key=value>..."; }
+			EntityIndex index = EntityIndex::load(argv[2]);
+			vector<string> terms (argv + 3, argv + argc);
+			auto results = index.query(terms);
+			for (const auto & [path, count] : results)
+			{ console << path << " (" << count << " entities)" << endl; }
+			console << results.size() << " VMFs Found." << endl;
+			return 0;
+		}
+
+		// "region <vmf> <x1> <y1> <z1> <x2> <y2> <z2>" cuts out every brush and entity that touches the box between the two corners.
+		if (string(argv[1]) == "region")
+		{
+			if (argc != 9)
+			{ throw "Usage: region <vmf path> <x1> <y1> <z1> <x2> <y2> <z2>"; }
+			Box region;
+			try
+			{
+				region.add(stof(argv[3]), stof(argv[4]), stof(argv[5]));
+				region.add(stof(argv[6]), stof(argv[7]), stof(argv[8]));
+			}
+			catch (const logic_error &) // A coordinate isn't a number. (invalid_argument or out_of_range)
+			{ throw "Usage: region <vmf path> <x1> <y1> <z1> <x2> <y2> <z2>"; }
+
+			console << "Reading File..." << endl;
+			VDF vmf = VDF::parse_from_filepath(argv[2]);
+			console << "Indexing Brushes And Entities..." << endl;
+			RegionIndex index {vmf};
+			console << "Cutting Out " << region.to_string() << "..." << endl;
+			VDF output = extract_region(vmf, index, region);
+
+			string output_filepath = string(argv[2]) + ".region.vmf";
+			console << "Writing to \"" << output_filepath << "\"" << endl;
+			output.serialize_to_filepath(output_filepath);
+			console << "Done!" << endl;
+			return 0;
+		}
+
+		// "serve <socket> [threads]" keeps running and processes jobs sent over a Unix domain socket.
+		if (string(argv[1]) == "serve")
+		{
+			if (argc < 3)
+			{ throw "Usage: serve <socket path> [thread count]"; }
+			unsigned thread_count = thread::hardware_concurrency();
+			if (argc >= 4)
+			{
+				// Every thread is started right away, so a typo like "-1" must not ask for billions of them.
+				const string text = argv[3];
+				long long requested = 0;
+				size_t parsed_length = 0;
+				try
+				{ requested = stoll(text, &parsed_length); }
+				catch (const logic_error &) // not a number (invalid_argument or out_of_range)
+				{}
+				if (parsed_length != text.size() || requested < 1 || requested > 1024)
+				{ throw "The thread count must be a number from 1 to 1024!"; }
+				thread_count = static_cast<unsigned>(requested);
+			}
+			if (thread_count == 0) // hardware_concurrency() doesn't know
+			{ thread_count = 1; }
+			console << "Serving on \"" << argv[2] << "\" with " << thread_count << " threads" << endl;
+			run_server(argv[2], thread_count);
+			console << "Server Stopped." << endl;
+			return 0;
+		}
+
+		// "client <socket> <input> <output> [profile]" sends a job to a running server.
+		// "client <socket> stats" and "client <socket> shutdown" send those requests instead.
+		if (string(argv[1]) == "client")
+		{
+			if (argc == 4 && (string(argv[3]) == "stats" || string(argv[3]) == "shutdown"))
+			{
+				console << send_request(argv[2], string(argv[3]) + " { }") << endl;
+				return 0;
+			}
+			if (argc < 5)
+			{ throw "Usage: client <socket path> <input path> <output path> [profile path]"; }
+			// The server may be running in a different folder, so it gets absolute paths.
+			auto absolute = [](const char * path) { return filesystem::absolute(path).string(); };
+			string request = make_extract_request(absolute(argv[3]), absolute(argv[4]), (argc >= 6) ? absolute(argv[5]) : "");
+			string response = send_request(argv[2], request);
+			console << response << endl;
+			// The exit code tells scripts whether the job worked.
+			return (response.find("\"status\" \"ok\"") != string::npos) ? 0 : 1;
+		}
+
 		vector<string> filepaths;
 		filepaths.reserve(argc-1);
 
+		// Every profile creates one output file per input file.
+		// "--profile" replaces the built-in environment profile, the other options add more variants.
+		vector<string> profile_filepaths;
+		bool want_lighting = false;
+		bool want_entities = false;
+
 		for (int i = 1; i < argc; ++i)
-		{ filepaths.push_back(argv[i]); }
+		{
+			string arg = argv[i];
+			if (arg == "--lighting")
+			{ want_lighting = true; }
+			else if (arg == "--entities")
+			{ want_entities = true; }
+			else if (arg == "--profile")
+			{
+				if (i+1 >= argc)
+				{ throw "\"--profile\" must be followed by the path of a profile file!"; }
+				profile_filepaths.push_back(argv[++i]);
+			}
+			else
+			{ filepaths.push_back(arg); }
+		}
 
-		for (string filepath : filepaths)
+		vector<Profile> loaded_profiles;
+		loaded_profiles.reserve(profile_filepaths.size());
+		for (const string & profile_filepath : profile_filepaths)
 		{
-			cout << "Processing \"" << filepath << "\"" << endl;
+			console << "Loading Profile \"" << profile_filepath << "\"" << endl;
+			loaded_profiles.push_back(Profile::load_from_filepath(profile_filepath));
+		}
 
-			if (!string_ends_with(filepath, ".vmf"))
+		vector<const Profile *> profiles;
+		for (const Profile & profile : loaded_profiles)
+		{ profiles.push_back(&profile); }
+		if (profiles.empty())
+		{ profiles.push_back(&Profile::environment()); }
+		if (want_lighting)
+		{ profiles.push_back(&Profile::lighting()); }
+		if (want_entities)
+		{ profiles.push_back(&Profile::entities()); }
+
+		// Two profiles with the same extension would write to the same file.
+		for (size_t i = 0; i < profiles.size(); ++i)
+		{
+			for (size_t j = 0; j < i; ++j)
 			{
-				cout << "WARNING: File name does not end with \".vmf\"! Skipping." << endl;
-				continue;
+				if (profiles[i]->extension == profiles[j]->extension)
+				{ throw runtime_error("The profiles \"" + profiles[j]->name + "\" and \"" + profiles[i]->name + "\" have the same extension \"" + profiles[i]->extension + "\"! Every profile needs its own extension."); }
 			}
+		}
 
-			cout << "Reading File..." << endl;
-			VDF vmf = VDF::parse_from_filepath(filepath);
-
-			cout << "Editing VMF..." << endl;
+		// There is only one stdout, so it can only take the output of one profile.
+		if (pipe_mode && profiles.size() > 1)
+		{ throw "\"-\" writes to stdout, which only works with a single profile! Leave out \"--lighting\", \"--entities\" and extra \"--profile\"s."; }
 
-			struct Pos3D
+		for (string filepath : filepaths)
+		{
+			if (filepath == "-")
 			{
-				float x, y, z;
-				string to_string()
-				{
-					ostringstream s;
-					s << x << " " << y << " " << z;
-					return s.str();
-				}
-			};
+				console << "Processing stdin" << endl;
+				// Every block is written as soon as it has been read, so the whole VMF is never in memory at once.
+				extract_stream(cin, profiles, {&cout});
+				continue;
+			}
+
+			console << "Processing \"" << filepath << "\"" << endl;
 
-			// This map stores the classnames of every relevant entity as keys.
-			// The associated position is the origin that we want this entity to have.
-			map<string, Pos3D> ent_map
+			if (!string_ends_with(filepath, ".vmf"))
 			{
-				{"color_correction",       { 40,  0, 16} },
-				{"env_fog_controller",     { -8,  0, 16} },
-				{"env_soundscape",         { 32,-16, 16} },
-				{"env_tonemap_controller", {  8,  0, 16} },
-				{"light_environment",      {-40,  0, 16} },
-				{"logic_auto",             { 24,  0, 16} },
-				{"shadow_control",         {-24,  0, 16} },
-				{"sky_camera",             {  0,-16, 16} },
-			};
-
-			// List of references to all entities that we are keeping in the VMF.
-			vector<shared_ptr<VDF>> kept_entities;
-
-			// Search for relevant entities and the world properties. Delete everything else.
-			for (VDF::KeyValue & vmf_kv : vmf)
+				console << "WARNING: File name does not end with \".vmf\"! Skipping." << endl;
+				continue;
+			}
+
+			// Every variant is written at the same time, so the file only has to be read once.
+			vector<string> output_filepaths;
+			for (const Profile * profile : profiles)
 			{
-				if (vmf_kv.key == "entity")
-				{
-					bool keep_entity = false;
-					VDF::KeyValue * origin_kv = nullptr;
-					string classname;
-
-					auto entity_ptr = get<shared_ptr<VDF>>(vmf_kv.val);
-					VDF & entity = *entity_ptr;
-
-					for (VDF::KeyValue & ent_kv : entity)
-					{
-						if (ent_kv.key == "classname")
-						{
-							classname = get<string>(ent_kv.val);
-							if (contains(ent_map, classname))
-							{ keep_entity = true; }
-						}
-						else if (ent_kv.key == "origin")
-						{
-							origin_kv = &ent_kv;
-						}
-					}
-
-					if (keep_entity)
-					{
-						bool entity_is_not_new = false;
-						for (const auto & ent : kept_entities)
-						{
-							// "classname" is included in the ignore list because it's identical anyway.
-							if (VDF::compare(entity, *ent, {"id", "origin", "classname", "editor"}, true))
-							{ entity_is_not_new = true; }
-						}
-						if (entity_is_not_new)
-						{
-							vmf_kv.clear();
-						}
-						else
-						{
-							kept_entities.push_back(entity_ptr);
-							if (origin_kv != nullptr)
-							{
-								origin_kv->val = ent_map[classname].to_string();
-								ent_map[classname].z += 16.0f;
-							}
-						}
-					}
-					else
-					{
-						vmf_kv.clear();
-					}
-				}
-				else if (vmf_kv.key == "world")
-				{
-					VDF & world = *get<shared_ptr<VDF>>(vmf_kv.val);
-					for (VDF::KeyValue & world_kv : world)
-					{
-						if (world_kv.key == "solid")
-						{ world_kv.clear(); }
-					}
-				}
-				else
-				{
-					vmf_kv.clear();
-				}
+				output_filepaths.push_back(filepath + profile->extension);
+				console << "Writing to \"" << output_filepaths.back() << "\" (" << profile->name << ")" << endl;
 			}
 
-			string output_filepath = filepath + ".env.vmf";
-			cout << "Writing to \"" << output_filepath << "\"" << endl;
-			vmf.serialize_to_filepath(output_filepath);
+			console << "Reading File..." << endl;
+			size_t allocations_before = allocation_count();
+			// Blocks that no profile keeps (like all the brushes) are thrown away without ever being parsed.
+			vector<ExtractionStats> stats = extract_file(filepath, profiles, output_filepaths);
+#ifdef VDF_COUNT_ALLOCATIONS
+			size_t allocations = allocation_count() - allocations_before;
+			console << "Extracting made " << allocations << " allocations for " << stats[0].input_bytes << " bytes" << endl;
+#else
+			(void)allocations_before;
+#endif
+			for (size_t i = 0; i < profiles.size(); ++i)
+			{ console << "Kept " << stats[i].kept_blocks << " of " << stats[i].blocks << " blocks (" << profiles[i]->name << ")" << endl; }
 		}
 
-		cout << "All Files Done!" << endl;
+		console << "All Files Done!" << endl;
 
 		return 0;
 	}
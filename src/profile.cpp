@@ -0,0 +1,286 @@
+#include "profile.hpp"
+
+#include <sstream>
+
+#include "utility.hpp"
+
+
+//// StringMatcher ////
+
+
+StringMatcher::StringMatcher(std::vector<std::string> names)
+: names(std::move(names))
+{
+	using namespace std;
+	// Twice as many slots as names keeps the search for a seed short.
+	size_t size = 1;
+	while (size < this->names.size() * 2)
+	{ size *= 2; }
+
+	// Try seeds until every name lands in its own slot. If that takes too long, make the table bigger.
+	while (true)
+	{
+		for (seed = 0; seed < 256; ++seed)
+		{
+			slots.assign(size, -1);
+			bool collision = false;
+			for (size_t i = 0; i < this->names.size() && !collision; ++i)
+			{
+				int & slot = slots[hash_string(this->names[i], seed) & (size - 1)];
+				if (slot != -1)
+				{ collision = true; }
+				slot = static_cast<int>(i);
+			}
+			if (!collision)
+			{ return; }
+		}
+		size *= 2;
+	}
+}
+
+[[nodiscard]] int StringMatcher::find(const std::string & name) const noexcept
+{
+	int index = slots[hash_string(name, seed) & (slots.size() - 1)];
+	return (index != -1 && names[index] == name) ? index : -1;
+}
+
+
+//// Profile ////
+
+
+std::string Profile::Pos3D::to_string() const
+{
+	using namespace std;
+	ostringstream s;
+	s << x << " " << y << " " << z;
+	return s.str();
+}
+
+// Reads a position in the form "x y z".
+static Profile::Pos3D parse_pos(const std::string & text)
+{
+	using namespace std;
+	Profile::Pos3D pos;
+	istringstream s {text};
+	if (!(s >> pos.x >> pos.y >> pos.z))
+	{ throw Profile::ProfileException("\"" + text + "\" is not a position! (Expected three numbers, like \"0 0 16\")"); }
+	return pos;
+}
+
+// Returns the string value of a KeyValue, or throws if it is a block.
+static const std::string & get_string(const VDF::KeyValue & kv)
+{
+	using namespace std;
+	if (!holds_alternative<string>(kv.val))
+	{ throw Profile::ProfileException("\"" + kv.key + "\" must be a string, not a block!"); }
+	return get<string>(kv.val);
+}
+
+// Returns the block value of a KeyValue, or throws if it is a string.
+static const VDF & get_block(const VDF::KeyValue & kv)
+{
+	using namespace std;
+	if (holds_alternative<string>(kv.val))
+	{ throw Profile::ProfileException("\"" + kv.key + "\" must be a block, not a string!"); }
+	return kv.get_vdf();
+}
+
+
+[[nodiscard]] bool Profile::match_classname(const std::string & classname, int & class_index) const
+{
+	class_index = classnames.find(classname);
+	if (class_index != -1)
+	{ return true; }
+	for (const std::string & pattern : patterns)
+	{
+		if (glob_match(pattern, classname))
+		{ return true; }
+	}
+	return false;
+}
+
+[[nodiscard]] bool Profile::keeps_in_world(const std::string & key) const
+{
+	if (contains(world_keep, key))
+	{ return true; }
+	if (contains(world_drop, key))
+	{ return false; }
+	return world_keep_by_default;
+}
+
+
+Profile Profile::load(const VDF & vdf)
+{
+	using namespace std;
+	auto profile_kvs = vdf.find_all("profile");
+	if (profile_kvs.size() != 1)
+	{ throw ProfileException("A profile must contain exactly one \"profile\" block!"); }
+
+	Profile profile;
+	vector<string> names;
+
+	for (const VDF::KeyValue & kv : get_block(*profile_kvs[0]))
+	{
+		if (kv.key == "name")
+		{
+			profile.name = get_string(kv);
+		}
+		else if (kv.key == "extension")
+		{
+			profile.extension = get_string(kv);
+		}
+		else if (kv.key == "origin_step")
+		{
+			profile.origin_step = parse_pos(get_string(kv));
+		}
+		else if (kv.key == "classnames")
+		{
+			for (const VDF::KeyValue & class_kv : get_block(kv))
+			{
+				for (const string & name : names)
+				{
+					if (name == class_kv.key)
+					{ throw ProfileException("The classname \"" + name + "\" is listed twice!"); }
+				}
+				names.push_back(class_kv.key);
+				ClassOrigin class_origin;
+				if (!get_string(class_kv).empty())
+				{
+					class_origin.has_origin = true;
+					class_origin.origin = parse_pos(get_string(class_kv));
+				}
+				profile.class_origins.push_back(class_origin);
+			}
+		}
+		else if (kv.key == "patterns")
+		{
+			for (const VDF::KeyValue & pattern_kv : get_block(kv))
+			{ profile.patterns.push_back(get_string(pattern_kv)); }
+		}
+		else if (kv.key == "world")
+		{
+			profile.keep_world = true;
+			for (const VDF::KeyValue & world_kv : get_block(kv))
+			{
+				const string & action = get_string(world_kv);
+				if (action != "keep" && action != "drop")
+				{ throw ProfileException("\"" + world_kv.key + "\" in \"world\" must be \"keep\" or \"drop\", not \"" + action + "\"!"); }
+				if (world_kv.key == "default")
+				{ profile.world_keep_by_default = (action == "keep"); }
+				else if (action == "keep")
+				{ profile.world_keep.insert(world_kv.key); }
+				else
+				{ profile.world_drop.insert(world_kv.key); }
+			}
+		}
+		else if (kv.key == "dedup")
+		{
+			profile.dedup = true;
+			for (const VDF::KeyValue & dedup_kv : get_block(kv))
+			{ profile.dedup_ignore_keys.insert(get_string(dedup_kv)); }
+		}
+		else
+		{
+			throw ProfileException("Unknown profile setting \"" + kv.key + "\"!");
+		}
+	}
+
+	if (profile.extension.empty())
+	{ throw ProfileException("The profile \"" + profile.name + "\" has no \"extension\"! (It would overwrite the input file.)"); }
+
+	profile.classnames = StringMatcher(move(names));
+	return profile;
+}
+
+Profile Profile::load_from_filepath(const std::string & filepath)
+{
+	return load(VDF::parse_from_filepath(filepath));
+}
+
+
+// The built-in profiles, in the same format as profile files.
+
+static const char * const environment_profile = R"(
+profile
+{
+	"name" "environment"
+	"extension" ".env.vmf"
+	classnames
+	{
+		"color_correction"       "40 0 16"
+		"env_fog_controller"     "-8 0 16"
+		"env_soundscape"         "32 -16 16"
+		"env_tonemap_controller" "8 0 16"
+		"light_environment"      "-40 0 16"
+		"logic_auto"             "24 0 16"
+		"shadow_control"         "-24 0 16"
+		"sky_camera"             "0 -16 16"
+	}
+	"origin_step" "0 0 16"
+	world
+	{
+		"solid" "drop"
+		"default" "keep"
+	}
+	dedup
+	{
+		"ignore" "id"
+		"ignore" "origin"
+		"ignore" "classname"
+		"ignore" "editor"
+	}
+}
+)";
+
+static const char * const lighting_profile = R"(
+profile
+{
+	"name" "lighting"
+	"extension" ".light.vmf"
+	classnames
+	{
+		"shadow_control" ""
+		"env_sun"        ""
+	}
+	patterns
+	{
+		// light, light_spot, light_dynamic, light_environment, ...
+		"pattern" "light*"
+	}
+	world
+	{
+		"solid" "drop"
+		"default" "keep"
+	}
+}
+)";
+
+static const char * const entities_profile = R"(
+profile
+{
+	"name" "entities"
+	"extension" ".ent.vmf"
+	patterns
+	{
+		"pattern" "*"
+	}
+}
+)";
+
+const Profile & Profile::environment()
+{
+	static const Profile profile = load(VDF::parse_from_string(environment_profile));
+	return profile;
+}
+
+const Profile & Profile::lighting()
+{
+	static const Profile profile = load(VDF::parse_from_string(lighting_profile));
+	return profile;
+}
+
+const Profile & Profile::entities()
+{
+	static const Profile profile = load(VDF::parse_from_string(entities_profile));
+	return profile;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept> // runtime_error
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "vdf.hpp"
+
+
+// Looks up a string in a fixed list of strings, with a single hash table probe and a single string comparison.
+// The hash function is seeded, and the seed is chosen when the table is built so that no two strings share a slot. (Perfect hashing)
+class StringMatcher
+{
+private:
+	std::vector<std::string> names;
+	// Index into `names` for every slot, or -1 if the slot is empty. The size is always a power of two.
+	std::vector<int> slots {-1};
+	// Seed for `hash_string()`.
+	std::uint64_t seed = 0;
+
+public:
+	// Construct an empty matcher. Matches nothing.
+	StringMatcher() = default;
+
+	// Builds the table for the given list. Duplicates must be removed beforehand.
+	explicit StringMatcher(std::vector<std::string> names);
+
+	// Returns the index of `name` in the list that was given to the constructor, or -1 if it isn't in there.
+	[[nodiscard]] int find(const std::string & name) const noexcept;
+
+	[[nodiscard]] std::size_t size() const noexcept { return names.size(); }
+};
+
+
+// Decides what an extraction keeps from a VMF. Profiles are read from VDF files, so that every game can have its own.
+// See "profiles/environment.vdf" for an example with every setting explained.
+struct Profile
+{
+	class ProfileException : public std::runtime_error
+	{
+	public:
+		using std::runtime_error::runtime_error; // use parent constructor
+	};
+
+	struct Pos3D
+	{
+		float x = 0, y = 0, z = 0;
+		std::string to_string() const;
+	};
+
+	// Name of the profile, only used for messages.
+	std::string name;
+	// Appended to the input file path to get the output file path.
+	std::string extension;
+
+	// Entities with these exact classnames are kept. Indices match `class_origins`.
+	StringMatcher classnames;
+	// Origin given to the first kept entity of each class in `classnames`. The origin isn't changed if `has_origin` is `false`.
+	struct ClassOrigin
+	{
+		bool has_origin = false;
+		Pos3D origin;
+	};
+	std::vector<ClassOrigin> class_origins;
+	// Entities with a classname matching one of these patterns are kept too. (See `glob_match()`)
+	std::vector<std::string> patterns;
+	// Every further entity of the same class is moved by this much.
+	Pos3D origin_step {0, 0, 16};
+
+	// If `false`, the world is removed.
+	bool keep_world = false;
+	// Keys and blocks in the world that are explicitly kept or dropped.
+	std::unordered_set<std::string> world_keep;
+	std::unordered_set<std::string> world_drop;
+	// What happens to keys and blocks in the world that are in neither list.
+	bool world_keep_by_default = true;
+
+	// If `true`, entities that are equal to an already kept entity are removed.
+	bool dedup = false;
+	// Keys that don't matter when looking for duplicate entities.
+	std::unordered_set<std::string> dedup_ignore_keys;
+
+	// Returns `true` if an entity with this classname is kept. `class_index` is set to the index into `class_origins`, or -1.
+	[[nodiscard]] bool match_classname(const std::string & classname, int & class_index) const;
+
+	// Returns `true` if a key or block with this name is kept inside of the world.
+	[[nodiscard]] bool keeps_in_world(const std::string & key) const;
+
+	// Reads a profile from a parsed VDF. The VDF must contain a single "profile" block.
+	// Throws `ProfileException` if something is wrong with it.
+	static Profile load(const VDF & vdf);
+
+	// Reads a profile from a VDF file.
+	// May throw exceptions. (File reading errors, malformed VDF text or `ProfileException`)
+	static Profile load_from_filepath(const std::string & filepath);
+
+	// The built-in profiles. These are used if no profile file is given.
+	static const Profile & environment();
+	static const Profile & lighting();
+	static const Profile & entities();
+};
@@ -0,0 +1,326 @@
+#include "region.hpp"
+
+#include <algorithm>
+#include <cmath> // abs
+#include <cstdlib> // strtof
+#include <sstream>
+
+#include "utility.hpp"
+
+
+//// Box ////
+
+
+void Box::add(float x, float y, float z) noexcept
+{
+	const float point[3] = {x, y, z};
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		min[axis] = std::min(min[axis], point[axis]);
+		max[axis] = std::max(max[axis], point[axis]);
+	}
+}
+
+void Box::add(const Box & other) noexcept
+{
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		min[axis] = std::min(min[axis], other.min[axis]);
+		max[axis] = std::max(max[axis], other.max[axis]);
+	}
+}
+
+[[nodiscard]] bool Box::intersects(const Box & other) const noexcept
+{
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		if (min[axis] > other.max[axis] || other.min[axis] > max[axis])
+		{ return false; }
+	}
+	return true;
+}
+
+std::string Box::to_string() const
+{
+	using namespace std;
+	ostringstream s;
+	s << "(" << min[0] << " " << min[1] << " " << min[2] << ") (" << max[0] << " " << max[1] << " " << max[2] << ")";
+	return s.str();
+}
+
+
+//// Bounds of VMF blocks ////
+
+
+// Reads up to `max_count` numbers from text like "(0 0 0) (64 0 0) (64 64 64)", ignoring brackets.
+// Returns how many numbers were found.
+static int parse_numbers(const std::string & text, float * numbers, int max_count)
+{
+	int count = 0;
+	const char * p = text.c_str();
+	while (*p != '\0' && count < max_count)
+	{
+		if (*p == '(' || *p == ')' || *p == '[' || *p == ']' || *p == ' ')
+		{
+			p += 1;
+			continue;
+		}
+		char * number_end = nullptr;
+		numbers[count] = std::strtof(p, &number_end);
+		if (number_end == p) // not a number
+		{ break; }
+		count += 1;
+		p = number_end;
+	}
+	return count;
+}
+
+// Returns the string value of the first `key` in `block`, or `nullptr` if there is none.
+static const std::string * find_string(const VDF & block, const std::string & key)
+{
+	using namespace std;
+	for (const VDF::KeyValue * kv : block.find_all(key))
+	{
+		if (holds_alternative<string>(kv->val))
+		{ return &get<string>(kv->val); }
+	}
+	return nullptr;
+}
+
+// Returns the first block called `key` in `block`, or `nullptr` if there is none.
+static const VDF * find_block(const VDF & block, const std::string & key)
+{
+	using namespace std;
+	for (const VDF::KeyValue * kv : block.find_all(key))
+	{
+		if (!holds_alternative<string>(kv->val))
+		{ return &kv->get_vdf(); }
+	}
+	return nullptr;
+}
+
+// A displacement moves every point of its face by `normal * distance + offset`, and the whole face by `elevation`.
+// Grows `reach` to how far any point of `dispinfo` can be moved away from its face along each axis.
+static void add_displacement_reach(const VDF & dispinfo, float reach[3])
+{
+	using namespace std;
+	// Displacements have at most 17 points per row.
+	constexpr int max_points = 17;
+
+	float elevation = 0;
+	if (const string * text = find_string(dispinfo, "elevation"))
+	{ parse_numbers(*text, &elevation, 1); }
+
+	const VDF * normals = find_block(dispinfo, "normals");
+	const VDF * distances = find_block(dispinfo, "distances");
+	const VDF * offsets = find_block(dispinfo, "offsets");
+	// The rows are called "row0", "row1", ..., and every block has the same rows.
+	for (int row = 0; ; ++row)
+	{
+		const string row_key = "row" + std::to_string(row);
+		const string * normal_text = normals ? find_string(*normals, row_key) : nullptr;
+		const string * distance_text = distances ? find_string(*distances, row_key) : nullptr;
+		const string * offset_text = offsets ? find_string(*offsets, row_key) : nullptr;
+		if (!normal_text && !distance_text && !offset_text)
+		{ break; }
+
+		float row_normals[3 * max_points] = {};
+		float row_distances[max_points] = {};
+		float row_offsets[3 * max_points] = {};
+		int normal_count = normal_text ? parse_numbers(*normal_text, row_normals, 3 * max_points) / 3 : 0;
+		int distance_count = distance_text ? parse_numbers(*distance_text, row_distances, max_points) : 0;
+		int offset_count = offset_text ? parse_numbers(*offset_text, row_offsets, 3 * max_points) / 3 : 0;
+		int point_count = max(offset_count, min(normal_count, distance_count));
+		for (int point = 0; point < point_count; ++point)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				float moved = row_normals[3 * point + axis] * row_distances[point] + row_offsets[3 * point + axis];
+				// The elevation moves along the normal of the face, which is at most `elevation` along any axis.
+				reach[axis] = max(reach[axis], abs(moved) + abs(elevation));
+			}
+		}
+		if (point_count == 0)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+			{ reach[axis] = max(reach[axis], abs(elevation)); }
+		}
+	}
+}
+
+// Grows `bounds` by the points of every plane and every origin in `block`, including everything inside of it.
+// Grows `reach` by how far displacements in `block` stick out of their faces.
+static void add_points(const VDF & block, Box & bounds, float reach[3])
+{
+	using namespace std;
+	for (const VDF::KeyValue & kv : block)
+	{
+		if (!holds_alternative<string>(kv.val))
+		{
+			if (kv.key == "dispinfo")
+			{ add_displacement_reach(kv.get_vdf(), reach); }
+			else
+			{ add_points(kv.get_vdf(), bounds, reach); }
+			continue;
+		}
+
+		// A plane is given by three points on it, and Hammer uses corners of the face for them.
+		float numbers[9];
+		if (kv.key == "plane" && parse_numbers(get<string>(kv.val), numbers, 9) == 9)
+		{
+			for (int i = 0; i < 9; i += 3)
+			{ bounds.add(numbers[i], numbers[i+1], numbers[i+2]); }
+		}
+		else if (kv.key == "origin" && parse_numbers(get<string>(kv.val), numbers, 3) == 3)
+		{
+			bounds.add(numbers[0], numbers[1], numbers[2]);
+		}
+	}
+}
+
+// Grows `bounds` so that it holds everything in `block`, including displacements.
+static void add_bounds(const VDF & block, Box & bounds)
+{
+	float reach[3] = {0, 0, 0};
+	add_points(block, bounds, reach);
+	// Every face of a brush lies inside the box of its plane points, so growing that box by the reach covers all displacements.
+	if (!bounds.empty())
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			bounds.min[axis] -= reach[axis];
+			bounds.max[axis] += reach[axis];
+		}
+	}
+}
+
+
+//// RegionIndex ////
+
+
+[[nodiscard]] bool RegionIndex::is_placed(const VDF::KeyValue & kv)
+{
+	using namespace std;
+	// Hidden brushes and entities are wrapped in a "hidden" block.
+	return !holds_alternative<string>(kv.val)
+	&& (kv.key == "solid" || kv.key == "entity" || kv.key == "hidden");
+}
+
+RegionIndex::RegionIndex(const VDF & vmf)
+{
+	auto add_item = [this](const VDF::KeyValue & kv)
+	{
+		Item item {Box{}, &kv.get_vdf()};
+		add_bounds(*item.block, item.bounds);
+		if (!item.bounds.empty())
+		{ items.push_back(item); }
+	};
+
+	for (const VDF::KeyValue & vmf_kv : vmf)
+	{
+		if (is_placed(vmf_kv))
+		{
+			add_item(vmf_kv);
+		}
+		else if (vmf_kv.key == "world" && !std::holds_alternative<std::string>(vmf_kv.val))
+		{
+			for (const VDF::KeyValue & world_kv : vmf_kv.get_vdf())
+			{
+				if (is_placed(world_kv))
+				{ add_item(world_kv); }
+			}
+		}
+	}
+
+	if (items.empty())
+	{ return; }
+	// A binary tree with one item per leaf has less than twice as many nodes as items.
+	nodes.reserve(2 * items.size());
+	nodes.push_back(Node{Box{}, 0, items.size()});
+	build(0, 0, items.size());
+}
+
+void RegionIndex::build(std::size_t node, std::size_t begin, std::size_t end)
+{
+	using namespace std;
+	// Few enough items to just look at all of them.
+	constexpr size_t leaf_size = 4;
+
+	Box bounds;
+	Box centers;
+	for (size_t i = begin; i < end; ++i)
+	{
+		bounds.add(items[i].bounds);
+		centers.add(items[i].bounds.center(0), items[i].bounds.center(1), items[i].bounds.center(2));
+	}
+	nodes[node].bounds = bounds;
+	if (end - begin <= leaf_size)
+	{ return; }
+
+	// Split along the axis where the items are spread out the most, with half of the items on each side.
+	int axis = 0;
+	for (int a = 1; a < 3; ++a)
+	{
+		if (centers.max[a] - centers.min[a] > centers.max[axis] - centers.min[axis])
+		{ axis = a; }
+	}
+	size_t middle = begin + (end - begin) / 2;
+	nth_element(items.begin() + begin, items.begin() + middle, items.begin() + end, [axis](const Item & a, const Item & b)
+	{ return a.bounds.center(axis) < b.bounds.center(axis); });
+
+	size_t left = nodes.size();
+	nodes[node].left = left;
+	nodes.push_back(Node{Box{}, begin, middle});
+	nodes.push_back(Node{Box{}, middle, end});
+	build(left, begin, middle);
+	build(left + 1, middle, end);
+}
+
+[[nodiscard]] std::unordered_set<const VDF *> RegionIndex::query(const Box & region) const
+{
+	using namespace std;
+	unordered_set<const VDF *> result;
+	if (nodes.empty())
+	{ return result; }
+
+	vector<size_t> stack {0};
+	while (!stack.empty())
+	{
+		const Node & node = nodes[stack.back()];
+		stack.pop_back();
+		if (!node.bounds.intersects(region))
+		{ continue; }
+		if (node.left != 0)
+		{
+			stack.push_back(node.left);
+			stack.push_back(node.left + 1);
+			continue;
+		}
+		for (size_t i = node.begin; i < node.end; ++i)
+		{
+			if (items[i].bounds.intersects(region))
+			{ result.insert(items[i].block); }
+		}
+	}
+	return result;
+}
+
+
+[[nodiscard]] VDF extract_region(const VDF & vmf, const RegionIndex & index, const Box & region)
+{
+	using namespace std;
+	const unordered_set<const VDF *> selected = index.query(region);
+	auto keep = [&selected](const VDF::KeyValue & kv)
+	{ return !RegionIndex::is_placed(kv) || contains(selected, &kv.get_vdf()); };
+
+	// Shallow copy. Nested blocks are still shared with `vmf`, which is how the index knows them.
+	VDF result = vmf;
+	for (VDF::KeyValue & vmf_kv : result)
+	{
+		// Editing the world copies its list of KeyValues, but the brushes inside are still shared.
+		if (vmf_kv.key == "world" && !holds_alternative<string>(vmf_kv.val))
+		{ vmf_kv.edit_vdf().retain(keep); }
+	}
+	result.retain(keep);
+	return result;
+}
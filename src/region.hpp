@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "vdf.hpp"
+
+
+// A box with sides parallel to the axes, in Hammer units. A new box is empty, and grows by adding points to it.
+struct Box
+{
+	float min[3] = {1e30f, 1e30f, 1e30f};
+	float max[3] = {-1e30f, -1e30f, -1e30f};
+
+	// Returns `true` if nothing has been added to this box yet.
+	[[nodiscard]] bool empty() const noexcept { return min[0] > max[0]; }
+
+	// Grows the box so that it contains the point.
+	void add(float x, float y, float z) noexcept;
+
+	// Grows the box so that it contains `other`.
+	void add(const Box & other) noexcept;
+
+	// Returns `true` if the boxes overlap or touch. Empty boxes overlap nothing.
+	[[nodiscard]] bool intersects(const Box & other) const noexcept;
+
+	// Returns the position of the center along one axis. (0 = x, 1 = y, 2 = z)
+	[[nodiscard]] float center(int axis) const noexcept { return (min[axis] + max[axis]) / 2; }
+
+	[[nodiscard]] std::string to_string() const;
+};
+
+
+// Finds the brushes and entities of a VMF that are inside a box, without looking at every single one of them.
+// The bounds of every brush in the world and every entity are calculated once, from the points of their planes and their origins.
+// They are stored in a bounding volume hierarchy (BVH), a binary tree where every node has a box around everything below it.
+// A query skips every node whose box is outside of the region, so it only looks at the blocks close to the region.
+class RegionIndex
+{
+public:
+	// Calculates the bounds of the brushes and entities in `vmf`.
+	// The VMF must stay alive and unchanged for as long as the index is used.
+	// May throw exceptions. (Malformed VDF text in lazy blocks)
+	explicit RegionIndex(const VDF & vmf);
+
+	// Returns every brush and entity whose bounds overlap `region`. Blocks that are only partly inside are included.
+	// The result contains the nested VDFs of the blocks, which are shared with shallow copies of the VMF.
+	// Blocks without any position (no planes and no origin) are never included.
+	[[nodiscard]] std::unordered_set<const VDF *> query(const Box & region) const;
+
+	// Returns `true` if a KeyValue is a brush or entity, i.e. something that the index looks at.
+	[[nodiscard]] static bool is_placed(const VDF::KeyValue & kv);
+
+	[[nodiscard]] std::size_t size() const noexcept { return items.size(); }
+
+private:
+	struct Item
+	{
+		Box bounds;
+		const VDF * block;
+	};
+
+	// The items of a node are `items[begin, end)`. Nodes without children have `left == 0`, otherwise the children are
+	// `nodes[left]` and `nodes[left+1]`. (The root is `nodes[0]`, so it can never be a child.)
+	struct Node
+	{
+		Box bounds;
+		std::size_t begin, end;
+		std::size_t left = 0;
+	};
+
+	// Sorted so that the items of every node are next to each other.
+	std::vector<Item> items;
+	std::vector<Node> nodes;
+
+	void build(std::size_t node, std::size_t begin, std::size_t end);
+};
+
+
+// Derives a new VMF from an already parsed one, with only the brushes and entities whose bounds overlap `region`.
+// Everything else (like the world's settings, visgroups and cameras) is kept, so the result can be opened in Hammer.
+// The input is never changed, and every block that isn't edited stays shared between the input and the result.
+[[nodiscard]] VDF extract_region(const VDF & vmf, const RegionIndex & index, const Box & region);
@@ -0,0 +1,570 @@
+#include "server.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <map>
+#include <memory>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "vdf.hpp"
+#include "profile.hpp"
+#include "extract.hpp"
+
+
+// Turns a VDF into a single line of text, which is how messages are separated.
+static std::string to_line(const VDF & vdf)
+{
+	using namespace std;
+	string line;
+	for (char c : vdf.serialize_to_string())
+	{
+		if (c == '\t')
+		{ continue; }
+		line += (c == '\n') ? ' ' : c;
+	}
+	if (!line.empty() && line.back() == ' ')
+	{ line.back() = '\n'; }
+	return line;
+}
+
+// VDF strings can't contain quotes, so they are replaced.
+static std::string sanitize(std::string s)
+{
+	for (char & c : s)
+	{
+		if (c == '"' || c == '\n')
+		{ c = '\''; }
+	}
+	return s;
+}
+
+// Builds a response line.
+static std::string make_result(std::vector<VDF::KeyValue> values)
+{
+	using namespace std;
+	VDF result;
+	result.emplace_back("result", make_shared<VDF>(move(values)));
+	return to_line(result);
+}
+
+std::string make_extract_request(const std::string & input_filepath, const std::string & output_filepath, const std::string & profile_filepath)
+{
+	using namespace std;
+	for (const string * path : {&input_filepath, &output_filepath, &profile_filepath})
+	{
+		if (path->find_first_of("\"\n") != string::npos)
+		{ throw runtime_error("File paths sent to the server can't contain quotes or newlines!"); }
+	}
+	VDF request;
+	request.emplace_back("extract", make_shared<VDF>(vector<VDF::KeyValue>
+	{
+		{"input", input_filepath},
+		{"output", output_filepath},
+		{"profile", profile_filepath},
+	}));
+	return to_line(request);
+}
+
+
+#ifdef _WIN32
+
+void run_server(const std::string &, unsigned)
+{
+	throw std::runtime_error("The server isn't available on Windows!");
+}
+
+std::string send_request(const std::string &, const std::string &)
+{
+	throw std::runtime_error("The server isn't available on Windows!");
+}
+
+#else
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+// Throws an exception that includes the description of `errno`.
+[[noreturn]] static void throw_socket_error(const std::string & what)
+{
+	throw std::runtime_error(what + " (" + std::strerror(errno) + ")");
+}
+
+static sockaddr_un make_address(const std::string & socket_path)
+{
+	sockaddr_un address {};
+	address.sun_family = AF_UNIX;
+	if (socket_path.size() >= sizeof(address.sun_path))
+	{ throw std::runtime_error("Socket path is too long!"); }
+	std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+	return address;
+}
+
+// Writing to a connection that the other side closed raises SIGPIPE, which would end the program.
+// Linux can turn that off for each send(). macOS and the BSDs can't, so there the signal is ignored for the whole program.
+#ifdef MSG_NOSIGNAL
+static const int send_flags = MSG_NOSIGNAL;
+static void ignore_sigpipe() {}
+#else
+static const int send_flags = 0;
+static void ignore_sigpipe() { std::signal(SIGPIPE, SIG_IGN); }
+#endif
+
+// Writes the whole string, even if the socket only takes part of it at a time.
+static bool write_all(int fd, const std::string & s)
+{
+	std::size_t done = 0;
+	while (done < s.size())
+	{
+		ssize_t n = ::send(fd, s.data() + done, s.size() - done, send_flags);
+		if (n < 0 && errno == EINTR)
+		{ continue; }
+		if (n <= 0)
+		{ return false; }
+		done += static_cast<std::size_t>(n);
+	}
+	return true;
+}
+
+// Reads from the socket until a full line is available. Left-over characters stay in `buffer` for the next line.
+// Returns `false` if the connection was closed first.
+static bool read_line(int fd, std::string & buffer, std::string & line)
+{
+	char chunk[4096];
+	while (true)
+	{
+		std::size_t newline = buffer.find('\n');
+		if (newline != std::string::npos)
+		{
+			line.assign(buffer, 0, newline);
+			buffer.erase(0, newline + 1);
+			return true;
+		}
+		ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+		if (n < 0 && errno == EINTR)
+		{ continue; }
+		if (n <= 0)
+		{ return false; }
+		buffer.append(chunk, static_cast<std::size_t>(n));
+	}
+}
+
+
+// Everything the worker threads share.
+// The main thread waits for new connections and incoming requests with poll(), and hands every complete request line to the
+// workers. Idle connections don't need a worker, so they can't hold up other jobs or a shutdown.
+// While a request of a connection is being handled, the connection isn't read from, so its answers come back in order.
+class Server
+{
+public:
+	Server(int listen_fd, unsigned thread_count)
+	: listen_fd(listen_fd)
+	, thread_count(thread_count)
+	{
+		// Workers write to this pipe when they are done with a request, to wake up poll() in run().
+		if (::pipe(wake_pipe) < 0)
+		{ throw_socket_error("Creating a pipe failed!"); }
+		try
+		{
+			for (unsigned i = 0; i < thread_count; ++i)
+			{ workers.emplace_back(&Server::work, this); }
+		}
+		catch (...)
+		{
+			// The destructor doesn't run, and threads that were started must be joined before they are destroyed.
+			stop_workers();
+			::close(wake_pipe[0]);
+			::close(wake_pipe[1]);
+			throw;
+		}
+	}
+
+	~Server()
+	{
+		stop_workers();
+		::close(wake_pipe[0]);
+		::close(wake_pipe[1]);
+	}
+
+	// Accepts connections and reads requests until a shutdown request comes in, then waits for all workers to finish.
+	void run()
+	{
+		std::vector<pollfd> poll_fds;
+		while (!stopping)
+		{
+			poll_fds.clear();
+			poll_fds.push_back(pollfd{wake_pipe[0], POLLIN, 0});
+			poll_fds.push_back(pollfd{listen_fd, POLLIN, 0});
+			for (const auto & [fd, connection] : connections)
+			{
+				if (!connection.busy)
+				{ poll_fds.push_back(pollfd{fd, POLLIN, 0}); }
+			}
+
+			if (::poll(poll_fds.data(), poll_fds.size(), -1) < 0)
+			{
+				if (errno == EINTR)
+				{ continue; }
+				int error = errno;
+				stop_workers();
+				errno = error;
+				throw_socket_error("Waiting for requests failed!");
+			}
+
+			if (poll_fds[0].revents != 0)
+			{ finish_requests(); }
+			if (poll_fds[1].revents != 0)
+			{ accept_connection(); }
+			for (std::size_t i = 2; i < poll_fds.size(); ++i)
+			{
+				if (poll_fds[i].revents != 0)
+				{ read_requests(poll_fds[i].fd); }
+			}
+		}
+		stop_workers();
+	}
+
+private:
+	// A connection that only the main thread touches, except for the workers writing answers to `fd` while it is busy.
+	struct Connection
+	{
+		// Characters that were received, but aren't a complete request line yet.
+		std::string buffer;
+		// `true` while a worker handles a request of this connection.
+		bool busy = false;
+	};
+
+	// A request line, and the connection that the answer goes to.
+	struct Request
+	{
+		int fd;
+		std::string line;
+	};
+
+	int listen_fd;
+	unsigned thread_count;
+	int wake_pipe[2];
+	std::vector<std::thread> workers;
+	std::atomic<bool> stopping {false};
+	std::map<int, Connection> connections;
+
+	std::mutex queue_mutex;
+	std::condition_variable queue_cv;
+	std::queue<Request> requests;
+	// Connections whose requests have been answered, so they can be read from again.
+	std::vector<int> finished;
+
+	// Loaded profiles, by file path. They stay loaded until the server stops.
+	std::mutex profile_mutex;
+	std::map<std::string, std::shared_ptr<const Profile>> profiles;
+
+	std::atomic<std::size_t> jobs_done {0};
+	std::atomic<std::size_t> jobs_failed {0};
+	const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+	// Lets the workers finish the requests they are handling and waits for them. Requests that weren't started are dropped.
+	void stop_workers()
+	{
+		{
+			std::lock_guard<std::mutex> lock {queue_mutex};
+			stopping = true;
+		}
+		queue_cv.notify_all();
+		for (std::thread & worker : workers)
+		{ worker.join(); }
+		workers.clear();
+		for (const auto & [fd, connection] : connections)
+		{ ::close(fd); }
+		connections.clear();
+	}
+
+	void accept_connection()
+	{
+		int fd = ::accept(listen_fd, nullptr, nullptr);
+		if (fd < 0)
+		{
+			// The listening socket was shut down on purpose, or the client gave up already.
+			if (stopping || errno == EINTR || errno == ECONNABORTED)
+			{ return; }
+			int error = errno;
+			stop_workers();
+			errno = error;
+			throw_socket_error("Accepting a connection failed!");
+		}
+		connections.emplace(fd, Connection{});
+	}
+
+	void read_requests(int fd)
+	{
+		char chunk[4096];
+		ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+		if (n < 0 && errno == EINTR)
+		{ return; }
+		if (n <= 0) // closed by the client
+		{
+			::close(fd);
+			connections.erase(fd);
+			return;
+		}
+		connections[fd].buffer.append(chunk, static_cast<std::size_t>(n));
+		queue_next_request(fd);
+	}
+
+	// Hands the next complete request line of a connection to the workers, unless one is being handled already.
+	void queue_next_request(int fd)
+	{
+		Connection & connection = connections[fd];
+		std::size_t newline = connection.buffer.find('\n');
+		if (connection.busy || newline == std::string::npos)
+		{ return; }
+		Request request {fd, connection.buffer.substr(0, newline)};
+		connection.buffer.erase(0, newline + 1);
+		connection.busy = true;
+		{
+			std::lock_guard<std::mutex> lock {queue_mutex};
+			requests.push(std::move(request));
+		}
+		queue_cv.notify_one();
+	}
+
+	// Called when a worker woke up the main thread.
+	void finish_requests()
+	{
+		char drain[64];
+		while (::read(wake_pipe[0], drain, sizeof(drain)) == sizeof(drain))
+		{}
+		std::vector<int> done;
+		{
+			std::lock_guard<std::mutex> lock {queue_mutex};
+			done.swap(finished);
+		}
+		for (int fd : done)
+		{
+			connections[fd].busy = false;
+			// The client may have sent more than one request at once.
+			queue_next_request(fd);
+		}
+	}
+
+	void work()
+	{
+		// Errors go back to the client. Dumping the tokens of every broken request would only flood the server's output.
+		VDF::dump_parse_errors = false;
+		while (true)
+		{
+			Request request;
+			{
+				std::unique_lock<std::mutex> lock {queue_mutex};
+				queue_cv.wait(lock, [this]{ return stopping || !requests.empty(); });
+				if (stopping)
+				{ return; }
+				request = std::move(requests.front());
+				requests.pop();
+			}
+			// If the client is gone, the main thread notices when reading from the connection again.
+			write_all(request.fd, handle_request(request.line));
+			{
+				std::lock_guard<std::mutex> lock {queue_mutex};
+				finished.push_back(request.fd);
+			}
+			char wake = 1;
+			(void)::write(wake_pipe[1], &wake, 1);
+		}
+	}
+
+	std::string handle_request(const std::string & line)
+	{
+		using namespace std;
+		try
+		{
+			VDF request = VDF::parse_from_string(line);
+			auto it = request.begin();
+			if (it == request.end() || holds_alternative<string>(it->val))
+			{ throw runtime_error("A request must be a single block!"); }
+
+			if (it->key == "extract")
+			{
+				const VDF & job = it->get_vdf();
+				string input, output, profile_path;
+				for (const VDF::KeyValue & kv : job)
+				{
+					if (!holds_alternative<string>(kv.val))
+					{ continue; }
+					if (kv.key == "input") { input = get<string>(kv.val); }
+					else if (kv.key == "output") { output = get<string>(kv.val); }
+					else if (kv.key == "profile") { profile_path = get<string>(kv.val); }
+				}
+				if (input.empty() || output.empty())
+				{ throw runtime_error("An extract request needs an \"input\" and an \"output\"!"); }
+
+				auto start = chrono::steady_clock::now();
+				ExtractionStats stats;
+				try
+				{
+					shared_ptr<const Profile> profile = get_profile(profile_path);
+					stats = extract_file(input, output, *profile);
+				}
+				catch (...)
+				{
+					// Only jobs count as failed. A broken request is the client's problem.
+					jobs_failed += 1;
+					throw;
+				}
+				chrono::duration<double> seconds = chrono::steady_clock::now() - start;
+				jobs_done += 1;
+
+				return make_result({
+					{"status", "ok"},
+					{"seconds", to_string(seconds.count())},
+					{"input_bytes", to_string(stats.input_bytes)},
+					{"blocks", to_string(stats.blocks)},
+					{"kept_blocks", to_string(stats.kept_blocks)},
+				});
+			}
+			else if (it->key == "stats")
+			{
+				chrono::duration<double> uptime = chrono::steady_clock::now() - start_time;
+				size_t profile_count;
+				{
+					lock_guard<mutex> lock {profile_mutex};
+					profile_count = profiles.size();
+				}
+				return make_result({
+					{"status", "ok"},
+					{"uptime_seconds", to_string(uptime.count())},
+					{"jobs_done", to_string(jobs_done)},
+					{"jobs_failed", to_string(jobs_failed)},
+					{"cached_profiles", to_string(profile_count)},
+					{"threads", to_string(thread_count)},
+				});
+			}
+			else if (it->key == "shutdown")
+			{
+				// run() notices this as soon as the answer has been sent and this worker wakes it up.
+				stopping = true;
+				return make_result({{"status", "ok"}});
+			}
+			throw runtime_error("Unknown request \"" + it->key + "\"!");
+		}
+		catch (const std::exception & e)
+		{
+			return make_result({{"status", "error"}, {"message", sanitize(e.what())}});
+		}
+	}
+
+	// Returns the profile at `path`, loading it only the first time. An empty path is the built-in environment profile.
+	std::shared_ptr<const Profile> get_profile(const std::string & path)
+	{
+		using namespace std;
+		if (path.empty())
+		{ return shared_ptr<const Profile>(shared_ptr<const Profile>{}, &Profile::environment()); }
+
+		lock_guard<mutex> lock {profile_mutex};
+		auto search = profiles.find(path);
+		if (search != profiles.end())
+		{ return search->second; }
+		auto profile = make_shared<const Profile>(Profile::load_from_filepath(path));
+		profiles.emplace(path, profile);
+		return profile;
+	}
+};
+
+
+void run_server(const std::string & socket_path, unsigned thread_count)
+{
+	sockaddr_un address = make_address(socket_path);
+	ignore_sigpipe();
+
+	int listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd < 0)
+	{ throw_socket_error("Creating the socket failed!"); }
+
+	// A socket file left over from an earlier run would make bind() fail, so it is removed.
+	// But only if it really is a socket, and no server is answering on it anymore.
+	struct stat info;
+	if (::lstat(socket_path.c_str(), &info) == 0)
+	{
+		if (!S_ISSOCK(info.st_mode))
+		{
+			::close(listen_fd);
+			throw std::runtime_error("\"" + socket_path + "\" already exists and isn't a socket!");
+		}
+		int probe_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		bool in_use = (probe_fd >= 0) && ::connect(probe_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+		if (probe_fd >= 0)
+		{ ::close(probe_fd); }
+		if (in_use)
+		{
+			::close(listen_fd);
+			throw std::runtime_error("Another server is already running on \"" + socket_path + "\"!");
+		}
+		::unlink(socket_path.c_str());
+	}
+	if (::bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+	{
+		::close(listen_fd);
+		throw_socket_error("Binding the socket to \"" + socket_path + "\" failed!");
+	}
+	if (::listen(listen_fd, 64) < 0)
+	{
+		::close(listen_fd);
+		throw_socket_error("Listening on the socket failed!");
+	}
+
+	try
+	{
+		Server server {listen_fd, thread_count == 0 ? 1 : thread_count};
+		server.run();
+	}
+	catch (...)
+	{
+		::close(listen_fd);
+		::unlink(socket_path.c_str());
+		throw;
+	}
+	::close(listen_fd);
+	::unlink(socket_path.c_str());
+}
+
+
+std::string send_request(const std::string & socket_path, const std::string & request)
+{
+	sockaddr_un address = make_address(socket_path);
+	ignore_sigpipe();
+
+	int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+	{ throw_socket_error("Creating the socket failed!"); }
+	if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+	{
+		::close(fd);
+		throw_socket_error("Connecting to \"" + socket_path + "\" failed!");
+	}
+
+	std::string line = request;
+	if (line.empty() || line.back() != '\n')
+	{ line += '\n'; }
+
+	std::string buffer;
+	std::string response;
+	bool ok = write_all(fd, line) && read_line(fd, buffer, response);
+	::close(fd);
+	if (!ok)
+	{ throw std::runtime_error("The server closed the connection without answering!"); }
+	return response;
+}
+
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+
+
+// The extraction server keeps running and processes extraction jobs that are sent to it over a Unix domain socket.
+// This saves the cost of starting a new process for every VMF, and loaded profiles stay cached between jobs.
+//
+// Every message is a single line of VDF text. A client sends one of these requests:
+//     extract { "input" "<path>" "output" "<path>" "profile" "<path, or empty for the built-in profile>" }
+//     stats { }
+//     shutdown { }
+// and receives a single line back:
+//     result { "status" "ok" ... }
+//     result { "status" "error" "message" "<what went wrong>" }
+// A connection may send any number of requests, one after another.
+// Only works on operating systems with Unix domain sockets.
+
+
+// Runs the server until a "shutdown" request comes in. `thread_count` requests are handled at the same time, no matter how many clients are connected.
+// Refuses to start if `socket_path` is something other than a socket, or if another server is still answering on it.
+// May throw exceptions. (Socket errors)
+void run_server(const std::string & socket_path, unsigned thread_count);
+
+// Connects to a running server, sends a single request line and returns the response line.
+// May throw exceptions. (Socket errors)
+std::string send_request(const std::string & socket_path, const std::string & request);
+
+// Builds a request line for an "extract" job.
+std::string make_extract_request(const std::string & input_filepath, const std::string & output_filepath, const std::string & profile_filepath);
@@ -25,6 +25,55 @@
 }
 
 
+[[nodiscard]] std::uint64_t hash_string(const std::string & s, std::uint64_t seed) noexcept
+{
+	// The seed is mixed into the offset basis.
+	std::uint64_t h = 14695981039346656037ull ^ (seed * 0x9E3779B97F4A7C15ull);
+	for (unsigned char c : s)
+	{
+		h ^= c;
+		h *= 1099511628211ull;
+	}
+	return h ^ (h >> 29);
+}
+
+
+[[nodiscard]] bool glob_match(const std::string & pattern, const std::string & s) noexcept
+{
+	using namespace std;
+	size_t p = 0, i = 0;
+	// Position of the last '*' in the pattern, and the position in `s` where it started matching.
+	size_t star = string::npos, star_i = 0;
+	while (i < s.size())
+	{
+		if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == s[i]))
+		{
+			p += 1;
+			i += 1;
+		}
+		else if (p < pattern.size() && pattern[p] == '*')
+		{
+			star = p;
+			star_i = i;
+			p += 1;
+		}
+		else if (star != string::npos) // let the last '*' match one more character and try again
+		{
+			p = star + 1;
+			star_i += 1;
+			i = star_i;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	while (p < pattern.size() && pattern[p] == '*')
+	{ p += 1; }
+	return p == pattern.size();
+}
+
+
 #ifdef __GNUG__
 #include <cstdlib>
 #include <memory>
@@ -41,4 +90,43 @@ std::string demangle(const char * name)
 {
 	return name;
 }
-#endif
\ No newline at end of file
+#endif
+
+
+#ifdef VDF_COUNT_ALLOCATIONS
+#include <atomic>
+#include <cstdlib>
+#include <new>
+static std::atomic<std::size_t> g_allocation_count {0};
+
+// Replacements of the global allocation functions, which count every call.
+// The array versions and the nothrow versions call these by default.
+void * operator new(std::size_t size)
+{
+	g_allocation_count.fetch_add(1, std::memory_order_relaxed);
+	if (void * ptr = std::malloc(size == 0 ? 1 : size))
+	{ return ptr; }
+	throw std::bad_alloc();
+}
+
+void operator delete(void * ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void * ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+[[nodiscard]] std::size_t allocation_count() noexcept
+{
+	return g_allocation_count.load(std::memory_order_relaxed);
+}
+#else
+// Does nothing if the counter is disabled
+[[nodiscard]] std::size_t allocation_count() noexcept
+{
+	return 0;
+}
+#endif
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <set>
 #include <unordered_set>
@@ -20,6 +21,21 @@
 [[nodiscard]] bool has_whitespace(const std::string & s);
 
 
+// Hashes a string with FNV-1a. Different seeds give unrelated hash functions.
+[[nodiscard]] std::uint64_t hash_string(const std::string & s, std::uint64_t seed = 0) noexcept;
+
+// Scrambles the bits of a hash, so that hashes can be combined by adding them up. (SplitMix64 finalizer)
+[[nodiscard]] inline std::uint64_t mix_hash(std::uint64_t h) noexcept
+{
+	h ^= h >> 30;
+	h *= 0xBF58476D1CE4E5B9ull;
+	h ^= h >> 27;
+	h *= 0x94D049BB133111EBull;
+	h ^= h >> 31;
+	return h;
+}
+
+
 // Checks if string `a` ends with string `b`.
 [[nodiscard]] inline bool string_ends_with(const std::string & a, const std::string & b)
 {
@@ -27,9 +43,14 @@
 }
 
 
+// Checks if the string `s` matches the pattern `pattern`.
+// `'*'` matches any number of characters (including none), `'?'` matches exactly one character. Everything else must match exactly.
+[[nodiscard]] bool glob_match(const std::string & pattern, const std::string & s) noexcept;
+
+
 // Checks if the set `set` containts the key `key`.
 template<class Key, class Compare, class Allocator>
-[[nodiscard]] inline bool contains(const std::set<Key,Compare,Allocator> & set, Key key)
+[[nodiscard]] inline bool contains(const std::set<Key,Compare,Allocator> & set, const Key & key)
 {
 	auto search = set.find(key);
 	return search != set.end();
@@ -38,7 +59,7 @@ template<class Key, class Compare, class Allocator>
 
 // Checks if the unordered set `set` containts the key `key`.
 template<class Key, class Compare, class Allocator>
-[[nodiscard]] inline bool contains(const std::unordered_set<Key,Compare,Allocator> & set, Key key)
+[[nodiscard]] inline bool contains(const std::unordered_set<Key,Compare,Allocator> & set, const Key & key)
 {
 	auto search = set.find(key);
 	return search != set.end();
@@ -47,7 +68,7 @@ template<class Key, class Compare, class Allocator>
 
 // Checks if the map `map` containts the key `key`.
 template<class Key, class T, class Compare, class Allocator>
-[[nodiscard]] inline bool contains(const std::map<Key,T,Compare,Allocator> & map, Key key)
+[[nodiscard]] inline bool contains(const std::map<Key,T,Compare,Allocator> & map, const Key & key)
 {
 	auto search = map.find(key);
 	return search != map.end();
@@ -63,3 +84,9 @@ inline std::string type(const T & t)
 {
 	return demangle(typeid(t).name());
 }
+
+
+// Returns the number of heap allocations made through `operator new` since the program started.
+// Only works if the program was compiled with `VDF_COUNT_ALLOCATIONS` defined, otherwise this always returns 0.
+// Useful for checking that changes to the parser don't make it allocate more than it needs to.
+[[nodiscard]] std::size_t allocation_count() noexcept;
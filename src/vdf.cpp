@@ -4,6 +4,7 @@
 #include <fstream>
 #include <sstream>
 #include <utility>
+#include <cstring> // memchr
 
 #include "utility.hpp"
 
@@ -24,6 +25,32 @@ void VDF::KeyValue::clear() noexcept
 	val = "";
 }
 
+[[nodiscard]] std::uint64_t VDF::KeyValue::hash(
+		const std::unordered_set<std::string> & ignore_keys,
+		std::unordered_map<const VDF *, std::uint64_t> * cache) const
+{
+	using namespace std;
+	uint64_t key_hash = hash_string(key, 1);
+	if (holds_alternative<string>(val))
+	{ return mix_hash(key_hash ^ hash_string(get<string>(val), 2)); }
+	return mix_hash(key_hash + get_vdf().hash(ignore_keys, cache));
+}
+
+[[nodiscard]] const VDF & VDF::KeyValue::get_vdf() const
+{
+	return *std::get<std::shared_ptr<VDF>>(val);
+}
+
+VDF & VDF::KeyValue::edit_vdf()
+{
+	using namespace std;
+	shared_ptr<VDF> & ptr = get<shared_ptr<VDF>>(val);
+	// Somebody else can see this VDF, so we make our own copy before anything gets changed.
+	if (ptr.use_count() > 1)
+	{ ptr = make_shared<VDF>(*ptr); }
+	return *ptr;
+}
+
 
 std::ostream & operator<<(std::ostream & os, const VDF::KeyValue & kv)
 {
@@ -59,6 +86,8 @@ std::ostream & operator<<(std::ostream & os, const VDF::Token & t)
 		os << "T(OpenBrace:" << get<int>(t.data) << ")"; break;
 	case VDF::Token::CloseBrace:
 		os << "T(CloseBrace:" << get<int>(t.data) << ")"; break;
+	case VDF::Token::Block:
+		os << "T(Block:" << get<VDF::SourceRange>(t.data).begin << "-" << get<VDF::SourceRange>(t.data).end << ")"; break;
 	case VDF::Token::End:
 		os << "T(End)"; break;
 	default:
@@ -68,39 +97,317 @@ std::ostream & operator<<(std::ostream & os, const VDF::Token & t)
 }
 
 
+//// VDF::Tokenizer ////
+
+
+// Only the ASCII whitespace characters `'\t'`, `'\n'`, `'\v'`, `'\f'`, `'\r'` and `' '` separate tokens.
+static inline bool is_whitespace(char c) noexcept
+{
+	return (c >= '\t' && c <= '\r') || (c == ' ');
+}
+
+void VDF::Tokenizer::throw_error(const std::vector<Token> & tokens, const char * what) const
+{
+	using namespace std;
+	if (dump_parse_errors)
+	{
+		cerr << "---- ERROR ---- ERROR ---- ERROR ----" << endl;
+		for (const Token & token : tokens) cerr << token << endl;
+		cerr << "position=" << position << ", brace_depth=" << brace_depth << ", skip_depth=" << skip_depth << endl;
+	}
+	throw TokenizationException(what);
+}
+
+void VDF::Tokenizer::emit(std::vector<Token> & tokens, decltype(Token::type) type)
+{
+	// Tokens inside of a skipped block are thrown away.
+	if (skip_depth == 0)
+	{ tokens.push_back(Token{type, std::move(pending)}); }
+	pending.clear();
+}
+
+void VDF::Tokenizer::feed(const char * chunk, std::size_t size, std::vector<Token> & tokens)
+{
+	using namespace std;
+	const char * const chunk_end = chunk + size;
+	const char * p = chunk;
+
+	// Appends the characters in [from, to) to the pending string, unless they would be thrown away anyway.
+	auto keep = [this](const char * from, const char * to)
+	{
+		if (skip_depth == 0)
+		{ pending.append(from, to); }
+	};
+
+	while (p < chunk_end)
+	{
+		switch (state)
+		{
+		case State::Between:
+		{
+			const char c = *p;
+			if (is_whitespace(c))
+			{
+				p += 1;
+			}
+			else if (c == '{') // open brace
+			{
+				// The key of a block is the last String, not counting comments.
+				size_t key_index = tokens.size();
+				while (key_index > 0 && tokens[key_index-1].type == Token::Comment)
+				{ key_index -= 1; }
+				const bool has_key = (skip_depth == 0 && key_index > 0 && tokens[key_index-1].type == Token::String);
+
+				if (skip_depth > 0)
+				{
+					skip_depth += 1;
+				}
+				else if (filter && has_key && !filter(block_keys, get<string>(tokens[key_index-1].data)))
+				{
+					// Throw away the key and everything inside, without ever looking at it.
+					tokens.resize(key_index-1);
+					skip_depth = 1;
+					discarding = true;
+				}
+				else if (lazy)
+				{
+					// Don't look inside, just remember where the block is.
+					skip_depth = 1;
+					block_begin = position + (p - chunk) + 1;
+				}
+				else
+				{
+					tokens.push_back(Token{Token::OpenBrace, brace_depth});
+					brace_depth += 1;
+					if (filter)
+					{ block_keys.push_back(has_key ? get<string>(tokens[key_index-1].data) : ""); }
+				}
+				p += 1;
+			}
+			else if (c == '}') // close brace
+			{
+				if (skip_depth > 0)
+				{
+					skip_depth -= 1;
+					if (skip_depth == 0 && !discarding)
+					{ tokens.push_back(Token{Token::Block, SourceRange{block_begin, position + (p - chunk)}}); }
+					if (skip_depth == 0)
+					{ discarding = false; }
+				}
+				else
+				{
+					brace_depth -= 1;
+					if (brace_depth < 0)
+					{ throw_error(tokens, "Negative brace depth! (There are more closing braces than opening braces.)"); }
+					tokens.push_back(Token{Token::CloseBrace, brace_depth});
+					if (!block_keys.empty())
+					{ block_keys.pop_back(); }
+				}
+				p += 1;
+			}
+			else if (c == '"') // string (delimited, may contain spaces)
+			{
+				state = State::Quoted;
+				p += 1;
+			}
+			else if (c == '/') // possibly a comment. the next character decides, and it might be in the next chunk
+			{
+				state = State::Slash;
+				p += 1;
+			}
+			else // string (not delimited, can't contain spaces)
+			{
+				state = State::Bare;
+			}
+			break;
+		}
+		case State::Quoted:
+		{
+			const char * q = static_cast<const char *>(memchr(p, '"', chunk_end - p));
+			if (q == nullptr) // string continues in the next chunk
+			{
+				keep(p, chunk_end);
+				p = chunk_end;
+				break;
+			}
+			keep(p, q);
+			emit(tokens, Token::String);
+			state = State::Between;
+			p = q + 1;
+			break;
+		}
+		case State::Slash:
+		{
+			if (*p == '/') // actually a comment
+			{
+				state = State::Comment;
+				p += 1;
+			}
+			else // not a comment? it's a string that starts with the slash
+			{
+				if (skip_depth == 0)
+				{ pending = "/"; }
+				state = State::Bare;
+			}
+			break;
+		}
+		case State::Comment:
+		{
+			const char * q = static_cast<const char *>(memchr(p, '\n', chunk_end - p));
+			if (q == nullptr) // comment continues in the next chunk
+			{
+				keep(p, chunk_end);
+				p = chunk_end;
+				break;
+			}
+			keep(p, q);
+			emit(tokens, Token::Comment);
+			state = State::Between;
+			p = q + 1;
+			break;
+		}
+		case State::Bare:
+		{
+			const char * q = p;
+			while (q < chunk_end && !is_whitespace(*q))
+			{ q += 1; }
+			keep(p, q);
+			p = q;
+			if (q < chunk_end) // found the end, otherwise the string continues in the next chunk
+			{
+				emit(tokens, Token::String);
+				state = State::Between;
+			}
+			break;
+		}
+		}
+	}
+
+	position += size;
+}
+
+void VDF::Tokenizer::finish(std::vector<Token> & tokens)
+{
+	switch (state)
+	{
+	case State::Between:
+		break;
+	case State::Quoted:
+		throw_error(tokens, "String without closing quote!");
+		break;
+	case State::Slash: // a single slash at the very end is a string
+		if (skip_depth == 0)
+		{ pending = "/"; }
+		emit(tokens, Token::String);
+		break;
+	case State::Comment: // newline not found, comment goes to the end
+		emit(tokens, Token::Comment);
+		break;
+	case State::Bare:
+		emit(tokens, Token::String);
+		break;
+	}
+	state = State::Between;
+
+	if (brace_depth > 0 || skip_depth > 0)
+	{ throw_error(tokens, "Positive brace depth! (There are more opening braces than closing braces.)"); }
+
+	tokens.push_back(Token{Token::End, -1});
+}
+
+
 //// VDF ////
 
 std::vector<VDF::KeyValue *> VDF::find_all(const std::string & key)
 {
 	using namespace std;
 	std::vector<VDF::KeyValue *> result;
+	find_all(key, result);
+	return result;
+}
+
+void VDF::find_all(const std::string & key, std::vector<KeyValue *> & result)
+{
+	using namespace std;
+	materialize();
+	result.clear();
 	for (KeyValue & kv : data)
 	{
 		if (kv.key == key)
 		{ result.push_back(&kv); }
 	}
-	return result;
 }
 
 const std::vector<const VDF::KeyValue *> VDF::find_all(const std::string & key) const
 {
 	using namespace std;
 	std::vector<const VDF::KeyValue *> result;
+	find_all(key, result);
+	return result;
+}
+
+void VDF::find_all(const std::string & key, std::vector<const KeyValue *> & result) const
+{
+	using namespace std;
+	materialize();
+	result.clear();
 	for (const KeyValue & kv : data)
 	{
 		if (kv.key == key)
 		{ result.push_back(&kv); }
 	}
-	return result;
+}
+
+[[nodiscard]] std::size_t VDF::count_recursive() const
+{
+	using namespace std;
+	materialize();
+	size_t count = 0;
+	for (const KeyValue & kv : data)
+	{
+		count += 1;
+		if (holds_alternative<shared_ptr<VDF>>(kv.val))
+		{ count += get<shared_ptr<VDF>>(kv.val)->count_recursive(); }
+	}
+	return count;
+}
+
+[[nodiscard]] std::uint64_t VDF::hash(
+		const std::unordered_set<std::string> & ignore_keys,
+		std::unordered_map<const VDF *, std::uint64_t> * cache) const
+{
+	using namespace std;
+	if (cache != nullptr)
+	{
+		auto search = cache->find(this);
+		if (search != cache->end())
+		{ return search->second; }
+	}
+
+	// Adding up the hashes of the KeyValues makes the order not matter.
+	uint64_t h = 0x5644465F424C4B31ull;
+	for (const KeyValue & kv : *this)
+	{
+		if (kv.empty() || contains(ignore_keys, kv.key))
+		{ continue; }
+		h += mix_hash(kv.hash(ignore_keys, cache));
+	}
+	h = mix_hash(h);
+
+	if (cache != nullptr)
+	{ cache->emplace(this, h); }
+	return h;
 }
 
 [[nodiscard]] bool VDF::compare(
 		const VDF & a,
 		const VDF & b,
 		const std::unordered_set<std::string> & ignore_keys,
-		bool ignore_order) noexcept
+		bool ignore_order)
 {
 	using namespace std;
+	a.materialize();
+	b.materialize();
 
 	if (ignore_order)
 	{
@@ -192,156 +499,66 @@ const std::vector<const VDF::KeyValue *> VDF::find_all(const std::string & key)
 }
 
 
-std::vector<VDF::Token> VDF::tokenize(const std::string & vdfstring)
+std::vector<VDF::Token> VDF::tokenize(const std::string & vdfstring, std::size_t begin, std::size_t end, bool lazy)
 {
 	using namespace std;
 	vector<Token> tokens;
 	// The worst average number of characters per token is about 25.
-	tokens.reserve(vdfstring.size() / 32);
-	int brace_depth = 0;
-	string::size_type i = 0; // index of current character
-	string::size_type j = 0; // used for string::find()
-
-	auto throw_error = [&tokens, &i, &brace_depth](const char * what) -> void
-	{
-		cerr << "---- ERROR ---- ERROR ---- ERROR ----" << endl;
-		for (Token & token : tokens) cerr << token << endl;
-		cerr << "i=" << i << ", brace_depth=" << brace_depth << endl;
-		throw TokenizationException(what);
-	};
-
-	while (i < vdfstring.size())
-	{
-		switch(vdfstring[i])
-		{
-		case '\t': case '\n': case '\v': case '\f': case '\r': case ' ': // whitespace
-		{
-			i += 1;
-			break;
-		}
-		case '{': // open brace
-		{
-			tokens.push_back(Token{Token::OpenBrace, brace_depth});
-			brace_depth += 1;
-			i += 1;
-			break;
-		}
-		case '}': // close brace
-		{
-			brace_depth -= 1;
-			if (brace_depth < 0)
-			{ throw_error("Negative brace depth! (There are more closing braces than opening braces.)"); }
-			tokens.push_back(Token{Token::CloseBrace, brace_depth});
-			i += 1;
-			break;
-		}
-		case '"': // string (delimited, may contain spaces)
-		{
-			j = vdfstring.find('"', i+1);
-			if (j == vdfstring.npos)
-			{ throw_error("String without closing quote!"); }
-			tokens.push_back(Token{Token::String, vdfstring.substr(i+1, j-i-1)});
-			i = j+1;
-			break;
-		}
-		case '/': // possibly a comment. check next character
-		{
-			char next = (i+1 < vdfstring.size()) ? vdfstring[i+1] : '\0';
-			if (next == '/') // actually a comment
-			{
-				j = vdfstring.find('\n', i+2);
-				if (j == vdfstring.npos)  // newline not found, slice to end
-				{
-					tokens.push_back(Token{Token::Comment, vdfstring.substr(i+2)});
-					i = j;
-				}
-				else
-				{
-					tokens.push_back(Token{Token::Comment, vdfstring.substr(i+2, j-i-2)});
-					i = j+1;
-				}
-				break;
-			}
-			// not a comment? fall-through to string
-		}
-		default: // string (not delimited, can't contain spaces)
-		{
-			j = i+1;
-			// find next whitespace character
-			while (true)
-			{
-				switch(vdfstring[j])
-				{
-				case '\0': // end of string
-					goto superbreak3774;
-				case '\t': case '\n': case '\v': case '\f': case '\r': case ' ': // whitespace
-					goto superbreak3774;
-				default:
-					j += 1;
-				}
-			}
-			superbreak3774:
-			tokens.push_back(Token{Token::String, vdfstring.substr(i, j-i)});
-			i = j;
-			break;
-		}
-		}
-	}
-
-	if (brace_depth > 0)
-	{ throw_error("Positive brace depth! (There are more opening braces than closing braces.)"); }
-
-	tokens.push_back(Token{Token::End, -1});
-
+	tokens.reserve((end - begin) / 32);
+	Tokenizer tokenizer {lazy, begin};
+	tokenizer.feed(vdfstring.data() + begin, end - begin, tokens);
+	tokenizer.finish(tokens);
 	return tokens;
 }
 
-VDF VDF::parse_tokens(const std::vector<VDF::Token> & tokens, int depth)
+VDF VDF::parse_tokens(std::vector<VDF::Token> & tokens, std::size_t begin, std::size_t end, int depth, const std::shared_ptr<const std::string> & source)
 {
 	using namespace std;
 	VDF result;
-	size_t i = 0;
+	size_t i = begin;
 
-	auto throw_error = [&tokens, &depth, &result, &i](const char * what) -> void
+	auto throw_error = [&tokens, &begin, &end, &depth, &result, &i](const char * what) -> void
 	{
-		cerr << "---- ERROR ---- ERROR ---- ERROR ----" << endl;
-		cerr << "tokens.size()=" << tokens.size() << endl;
-		for (const Token & token : tokens) cerr << token << endl;
-		cerr << "result.data.size()=" << result.data.size() << endl;
-		for (KeyValue & kv : result.data) cerr << kv << endl;
-		cerr << "i=" << i << ", tokens[i]=" << tokens[i] << endl;
-		cerr << "depth=" << depth << endl;
+		if (dump_parse_errors)
+		{
+			cerr << "---- ERROR ---- ERROR ---- ERROR ----" << endl;
+			cerr << "tokens.size()=" << tokens.size() << ", begin=" << begin << ", end=" << end << endl;
+			for (size_t t = begin; t < end; ++t) cerr << tokens[t] << endl;
+			cerr << "result.data.size()=" << result.data.size() << endl;
+			for (KeyValue & kv : result.data) cerr << kv << endl;
+			if (i < end) cerr << "i=" << i << ", tokens[i]=" << tokens[i] << endl;
+			cerr << "depth=" << depth << endl;
+		}
 		throw ParsingException(what);
 	};
 
-	while (i < tokens.size())
+	while (i < end)
 	{
-		const Token & token = tokens[i];
+		Token & token = tokens[i];
 
 		switch(token.type)
 		{
 		case VDF::Token::String:
 		{
 			size_t k = i;
-			Token next_token;
 
 			// Comments don't matter and need to be skipped over.
 			do
 			{
 				k += 1;
-				if (k >= tokens.size())
+				if (k >= end)
 				{ throw_error("Key string can't pair with a value because there are no more tokens to parse."); }
-				next_token = tokens[k];
 			}
-			while (next_token.type == VDF::Token::Comment);
+			while (tokens[k].type == VDF::Token::Comment);
 
 			i = k;
+			Token & next_token = tokens[k];
 
 			switch(next_token.type)
 			{
 			case VDF::Token::String:
 			{
-				result.data.push_back(KeyValue(get<string>(token.data), get<string>(next_token.data)));
+				result.data.emplace_back(move(get<string>(token.data)), move(get<string>(next_token.data)));
 				i += 1;
 				break;
 			}
@@ -350,9 +567,8 @@ VDF VDF::parse_tokens(const std::vector<VDF::Token> & tokens, int depth)
 				size_t j = i+1;
 				bool found = false;
 				const int target = get<int>(next_token.data);
-				vector<Token> braced_tokens;
 
-				while (j < tokens.size())
+				while (j < end)
 				{
 					if (tokens[j].type == VDF::Token::CloseBrace
 					&&  get<int>(tokens[j].data) == target)
@@ -360,22 +576,16 @@ VDF VDF::parse_tokens(const std::vector<VDF::Token> & tokens, int depth)
 						found = true;
 						break;
 					}
-					else
-					{
-						braced_tokens.push_back(tokens[j]);
-						j += 1;
-					}
+					j += 1;
 				}
 
 				if (!found)
 				{ throw_error("Opening brace without matching closing brace. (This should have been caught by the tokenizer!)"); }
 
-				braced_tokens.push_back(Token{Token::End, -1});
-
 				try
 				{
-					shared_ptr<VDF> tempvdf{make_shared<VDF>(move(parse_tokens(braced_tokens, depth+1)))};
-					result.data.push_back(KeyValue(get<string>(token.data), tempvdf));
+					// The braced tokens are parsed right where they are. No need to copy them anywhere.
+					result.data.emplace_back(move(get<string>(token.data)), make_shared<VDF>(parse_tokens(tokens, i+1, j, depth+1, source)));
 				}
 				catch (const ParsingException & ex)
 				{
@@ -385,6 +595,18 @@ VDF VDF::parse_tokens(const std::vector<VDF::Token> & tokens, int depth)
 				i = j+1;
 				break;
 			}
+			case VDF::Token::Block:
+			{
+				// Only remember where the block is. It gets parsed once somebody looks inside.
+				const SourceRange & range = get<SourceRange>(next_token.data);
+				auto tempvdf = make_shared<VDF>();
+				tempvdf->source = source;
+				tempvdf->source_begin = range.begin;
+				tempvdf->source_end = range.end;
+				result.data.emplace_back(move(get<string>(token.data)), move(tempvdf));
+				i += 1;
+				break;
+			}
 			default:
 				throw_error("Key string is followed by nonsense and is therefore left without a value!");
 			}
@@ -410,67 +632,222 @@ VDF VDF::parse_tokens(const std::vector<VDF::Token> & tokens, int depth)
 	return result;
 }
 
-std::string VDF::serialize(int depth)
+VDF VDF::parse_tokens(std::vector<VDF::Token> && tokens)
+{
+	return parse_tokens(tokens, 0, tokens.size(), 0, nullptr);
+}
+
+VDF::StreamParser::StreamParser(std::function<void(KeyValue &&)> on_key_value, BlockFilter filter)
+: tokenizer(false, 0, std::move(filter))
+, on_key_value(std::move(on_key_value))
+{}
+
+void VDF::StreamParser::feed(const char * chunk, std::size_t size)
+{
+	tokenizer.feed(chunk, size, tokens);
+	flush();
+}
+
+void VDF::StreamParser::finish()
+{
+	tokenizer.finish(tokens);
+	flush();
+	// Whatever is left can't be a complete KeyValue. Parsing it reports the error, or skips it if it's only comments.
+	VDF rest = parse_tokens(tokens, 0, tokens.size(), 0, nullptr);
+	tokens.clear();
+	scanned = 0;
+	for (KeyValue & kv : rest.data)
+	{ on_key_value(std::move(kv)); }
+}
+
+void VDF::StreamParser::flush()
 {
 	using namespace std;
-	ostringstream result;
-	const string tabs = string(depth, '\t');
-	for (const KeyValue & kv : data)
+	// Find the end of the last complete KeyValue at the outermost level.
+	size_t complete = 0;
+	// The last String might be the key of a block that the tokenizer throws away in the next chunk, which removes the String
+	// (and the comments after it) again. So it's looked at again next time, unless something other than a comment comes after it.
+	size_t last_string = tokens.size();
+	for (; scanned < tokens.size(); ++scanned)
 	{
-		if (holds_alternative<string>(kv.val))
-		{
-			if (kv.empty())
-			{ continue; } // ignore empty lines
+		if (tokens[scanned].type != Token::Comment)
+		{ last_string = tokens.size(); }
 
-			result << tabs << "\"" << kv.key << "\" \"" << get<string>(kv.val) << "\"\n";
-		}
-		else
+		switch (tokens[scanned].type)
 		{
-			if (has_whitespace(kv.key))
+		case Token::OpenBrace:
+			depth += 1;
+			break;
+		case Token::CloseBrace:
+			depth -= 1;
+			if (depth == 0) // end of a block
 			{
-				result << tabs << "\"" << kv.key << "\"";
+				complete = scanned+1;
+				strings_at_top = 0;
 			}
-			else
+			break;
+		case Token::String:
+			last_string = scanned;
+			if (depth == 0)
 			{
-				result << tabs << kv.key;
+				strings_at_top += 1;
+				if (strings_at_top == 2) // key and value
+				{
+					complete = scanned+1;
+					strings_at_top = 0;
+					last_string = tokens.size();
+				}
 			}
-			result << "\n" << tabs << "{\n"
-			<< get<shared_ptr<VDF>>(kv.val)->serialize(depth+1)
-			<< tabs << "}\n";
+			break;
+		default:
+			break;
+		}
+	}
+	if (last_string < tokens.size())
+	{
+		scanned = last_string;
+		if (depth == 0)
+		{ strings_at_top -= 1; }
+	}
+
+	if (complete == 0)
+	{ return; }
+
+	VDF parsed = parse_tokens(tokens, 0, complete, 0, nullptr);
+	tokens.erase(tokens.begin(), tokens.begin() + complete);
+	scanned -= complete;
+	for (KeyValue & kv : parsed.data)
+	{ on_key_value(std::move(kv)); }
+}
+
+void VDF::parse_source() const
+{
+	using namespace std;
+	vector<Token> tokens = tokenize(*source, source_begin, source_end, true);
+	VDF parsed = parse_tokens(tokens, 0, tokens.size(), 0, source);
+	data = move(parsed.data);
+	source.reset();
+}
+
+void VDF::serialize(std::ostream & os, int depth) const
+{
+	using namespace std;
+	const string tabs = string(depth, '\t');
+	for (const KeyValue & kv : data)
+	{ serialize(os, kv, tabs, depth); }
+}
+
+void VDF::serialize(std::ostream & os, const KeyValue & kv, const std::string & tabs, int depth)
+{
+	using namespace std;
+	if (holds_alternative<string>(kv.val))
+	{
+		if (kv.empty())
+		{ return; } // ignore empty lines
+
+		os << tabs << "\"" << kv.key << "\" \"" << get<string>(kv.val) << "\"\n";
+	}
+	else
+	{
+		if (has_whitespace(kv.key))
+		{
+			os << tabs << "\"" << kv.key << "\"";
+		}
+		else
+		{
+			os << tabs << kv.key;
+		}
+		const VDF & nested = *get<shared_ptr<VDF>>(kv.val);
+		if (nested.source)
+		{
+			// Never parsed, so it can't have been changed. Copy the original text.
+			os << "\n" << tabs << "{";
+			os.write(nested.source->data() + nested.source_begin, nested.source_end - nested.source_begin);
+			os << "}\n";
+		}
+		else
+		{
+			os << "\n" << tabs << "{\n";
+			nested.serialize(os, depth+1);
+			os << tabs << "}\n";
 		}
 	}
-	return result.str();
 }
 
 
 
 VDF VDF::parse_from_string(const std::string & vdfstring)
 {
-	return parse_tokens(tokenize(vdfstring), 0);
+	return parse_tokens(tokenize(vdfstring, 0, vdfstring.size(), false));
+}
+
+VDF VDF::parse_from_string(std::string && vdfstring)
+{
+	using namespace std;
+	vector<Token> tokens = tokenize(vdfstring, 0, vdfstring.size(), false);
+	// The tokens have their own copies of the strings, so the text isn't needed anymore.
+	string().swap(vdfstring);
+	return parse_tokens(move(tokens));
+}
+
+VDF VDF::parse_from_string_lazy(std::string vdfstring)
+{
+	using namespace std;
+	auto source = make_shared<const string>(move(vdfstring));
+	vector<Token> tokens = tokenize(*source, 0, source->size(), true);
+	return parse_tokens(tokens, 0, tokens.size(), 0, source);
 }
 
 VDF VDF::parse_from_filepath(const std::string & filepath)
+{
+	return parse_from_string(read_file(filepath));
+}
+
+VDF VDF::parse_from_filepath_lazy(const std::string & filepath)
+{
+	return parse_from_string_lazy(read_file(filepath));
+}
+
+std::string VDF::read_file(const std::string & filepath)
 {
 	using namespace std;
-	ostringstream filecontent;
 	fstream infile {filepath, ifstream::in};
 	infile.exceptions(ios_base::failbit);
-	filecontent << infile.rdbuf();
+	// Read the whole file straight into one string, instead of going through a stringstream and copying it out again.
+	infile.seekg(0, ios_base::end);
+	string filecontent (static_cast<size_t>(infile.tellg()), '\0');
+	infile.seekg(0, ios_base::beg);
+	infile.exceptions(ios_base::badbit);
+	infile.read(filecontent.data(), filecontent.size());
+	filecontent.resize(static_cast<size_t>(infile.gcount())); // text mode may shrink the content (\r\n -> \n)
 	infile.close();
-	return parse_from_string(filecontent.str());
+	return filecontent;
 }
 
-std::string VDF::serialize_to_string()
+std::string VDF::serialize_to_string() const
 {
-	return serialize(0);
+	using namespace std;
+	ostringstream result;
+	serialize(result, 0);
+	return result.str();
 }
 
-void VDF::serialize_to_filepath(const std::string & filepath)
+void VDF::serialize_to_stream(std::ostream & os) const
+{
+	serialize(os, 0);
+}
+
+void VDF::serialize_to_stream(std::ostream & os, const KeyValue & kv)
+{
+	serialize(os, kv, "", 0);
+}
+
+void VDF::serialize_to_filepath(const std::string & filepath) const
 {
 	using namespace std;
 	ofstream outfile {filepath};
 	outfile.exceptions(ios_base::failbit);
-	outfile << serialize_to_string();
+	serialize(outfile, 0);
 	outfile.close();
 }
 
@@ -481,6 +858,13 @@ void VDF::print_debug_recursive(int depth)
 	using namespace std;
 	const string tabs = string(depth*2, ' ');
 	cout << tabs << "<VDF>@" << this << " BEGIN" << endl;
+	if (source)
+	{
+		// Printing debug info shouldn't change anything, so lazy VDFs stay lazy.
+		cout << tabs << "(lazy, " << (source_end - source_begin) << " bytes not parsed yet)" << endl;
+		cout << tabs << "<VDF>@" << this << " END" << endl;
+		return;
+	}
 	cout << tabs << "(" << data.size() << " items)" << endl;
 	for (size_t i = 0; i < data.size(); ++i)
 	{
@@ -6,6 +6,12 @@
 #include <string>
 #include <stdexcept> // runtime_error
 #include <unordered_set>
+#include <unordered_map>
+#include <cstdint>
+#include <utility> // move, forward, swap
+#include <iterator> // make_move_iterator
+#include <iosfwd> // ostream
+#include <functional>
 
 
 class VDF
@@ -24,15 +30,17 @@ public:  // KeyValue definitions //
 
 		// Construct a KeyValue pair from string and VDF pointer.
 		// Using a nullptr is undefined behaviour.
-		KeyValue(const std::string & key, const std::shared_ptr<VDF> & val)
-		: key(key)
-		, val(val)
+		// Both arguments are taken by value, so pass them with `std::move()` to avoid copying.
+		KeyValue(std::string key, std::shared_ptr<VDF> val)
+		: key(std::move(key))
+		, val(std::move(val))
 		{}
 
-		// Construct a KeyValue pair from two strings
-		KeyValue(const std::string & key, const std::string & val)
-		: key(key)
-		, val(val)
+		// Construct a KeyValue pair from two strings.
+		// Both arguments are taken by value, so pass them with `std::move()` to avoid copying.
+		KeyValue(std::string key, std::string val)
+		: key(std::move(key))
+		, val(std::move(val))
 		{}
 
 		// Construct a new KeyValue pair from another. `val` points to the same VDF object. This is not a deep copy!
@@ -41,6 +49,12 @@ public:  // KeyValue definitions //
 		// Assign left-side KeyValue to be identical to the right-side KeyValue. `val` points to the same VDF object. This is not a deep copy!
 		KeyValue & operator=(const KeyValue & other) = default;
 
+		// Move Constructor.
+		KeyValue(KeyValue &&) noexcept = default;
+
+		// Move Assignment.
+		KeyValue & operator=(KeyValue &&) noexcept = default;
+
 		// Destructor.
 		~KeyValue() = default;
 
@@ -48,7 +62,23 @@ public:  // KeyValue definitions //
 		[[nodiscard]] bool empty() const noexcept;
 
 		// Clears both key and value, resetting them to the default state of two empty strings.
+		// Empty KeyValues are skipped when serializing, but they stay in their VDF. Use `VDF::erase_if()` to actually remove KeyValues.
 		void clear() noexcept;
+
+		// Returns a hash of this KeyValue, including everything inside of it. See `VDF::hash()`.
+		[[nodiscard]] std::uint64_t hash(
+				const std::unordered_set<std::string> & ignore_keys,
+				std::unordered_map<const VDF *, std::uint64_t> * cache) const;
+
+		// Returns the nested VDF as read-only. No copy is made.
+		// Throws `std::bad_variant_access` if the value is a string.
+		[[nodiscard]] const VDF & get_vdf() const;
+
+		// Returns the nested VDF for editing. If the nested VDF is also referenced by another KeyValue
+		// (for example because the parent VDF was copied), it is copied first, so that edits never show up in the other copies.
+		// The copy is shallow, so the nested VDFs of the nested VDF stay shared until they are edited as well. (Copy-on-write)
+		// Throws `std::bad_variant_access` if the value is a string.
+		VDF & edit_vdf();
 	};
 
 	friend std::ostream & operator<<(std::ostream & os, const KeyValue & t);
@@ -56,7 +86,15 @@ public:  // KeyValue definitions //
 private:  // member variables //
 
 	// stores all the actual data
-	std::vector<KeyValue> data;
+	// `mutable` because lazy VDFs are parsed on first access, which may happen through a const reference.
+	mutable std::vector<KeyValue> data;
+
+	// Only set if this VDF was created by lazy parsing and hasn't been looked at yet. `data` is empty in that case.
+	// The text between the braces of this block is `source[source_begin, source_end)`.
+	// The source text is shared by every lazy VDF created from it, and freed once none of them need it anymore.
+	mutable std::shared_ptr<const std::string> source;
+	mutable std::size_t source_begin = 0;
+	mutable std::size_t source_end = 0;
 
 public:  // basic class API //
 
@@ -64,30 +102,45 @@ public:  // basic class API //
 	VDF() = default;
 
 	// Construct VDF from list of KeyValue pairs.
-	VDF(const std::vector<KeyValue> & vec)
-	: data(vec)
+	// The list is taken by value, so pass it with `std::move()` to avoid copying.
+	VDF(std::vector<KeyValue> vec)
+	: data(std::move(vec))
 	{}
 
 	// Construct new VDF from another. This is not a deep copy!
+	// Nested VDFs are shared between both copies. Use `KeyValue::edit_vdf()` to edit them without affecting the other copy.
 	VDF(const VDF & other) = default;
 
 	// Assign left-side VDF to be identical to the right-side VDF. This is not a deep copy!
+	// Nested VDFs are shared between both copies. Use `KeyValue::edit_vdf()` to edit them without affecting the other copy.
 	VDF & operator=(const VDF & other) = default;
 
 	// Move Constructor.
-	VDF(VDF &&) = default;
+	VDF(VDF &&) noexcept = default;
+
+	// Move Assignment.
+	VDF & operator=(VDF &&) noexcept = default;
 
 	// Destructor.
 	~VDF() = default;
 
 	// Iterator stuff to allow range-based for loops.
+	// Lazy VDFs are parsed first, so these may throw.
+
+	inline auto cbegin() const { materialize(); return data.cbegin(); }
+	inline auto cend()   const { materialize(); return data.cend();   }
+	inline auto begin() const { return cbegin(); }
+	inline auto end()   const { return cend();   }
+	inline auto begin() { materialize(); return data.begin(); }
+	inline auto end()   { materialize(); return data.end();   }
+
+	// Returns `true` if this VDF came from lazy parsing and hasn't been parsed yet.
+	[[nodiscard]] inline bool is_lazy() const noexcept { return source != nullptr; }
 
-	inline auto cbegin() const noexcept { return data.cbegin(); }
-	inline auto cend()   const noexcept { return data.cend();   }
-	inline auto begin() const noexcept { return cbegin(); }
-	inline auto end()   const noexcept { return cend();   }
-	inline auto begin() noexcept { return data.begin(); }
-	inline auto end()   noexcept { return data.end();   }
+	// Parses this VDF if it is lazy. Nested VDFs stay lazy. Does nothing otherwise.
+	// Lazy parsing isn't thread-safe, so call this before sharing a lazy VDF between threads.
+	// Throws if the source text is malformed.
+	inline void materialize() const { if (source) { parse_source(); } }
 
 	// Returns a list of every KeyValue with matching `key`.
 	// The elements are raw pointers, which allows you to directly edit the VDF contents.
@@ -97,14 +150,76 @@ public:  // basic class API //
 	// `[const qualified]` The elements are read-only raw pointers.
 	const std::vector<const KeyValue *> find_all(const std::string & key) const;
 
+	// Same as the other `find_all()`, but writes the result into `result`, which is cleared first.
+	// Reusing the same `result` for many calls avoids allocating a new list every time.
+	void find_all(const std::string & key, std::vector<KeyValue *> & result);
+
+	// Same as the other `find_all()`, but writes the result into `result`, which is cleared first.
+	// `[const qualified]` The elements are read-only raw pointers.
+	void find_all(const std::string & key, std::vector<const KeyValue *> & result) const;
+
+	// Adds a new KeyValue to the end of this VDF. The arguments are forwarded to a KeyValue constructor.
+	template <class... Args>
+	KeyValue & emplace_back(Args &&... args)
+	{
+		materialize();
+		return data.emplace_back(std::forward<Args>(args)...);
+	}
+
+	// Removes every KeyValue for which `pred(kv)` returns `true`, keeping the order of the others, in a single pass.
+	// The removed KeyValues are destroyed together at the end, not in the middle of the pass. If `removed` isn't nullptr,
+	// they are moved into it instead, so that big blocks can be destroyed later (or on another thread) by the caller.
+	// Returns the number of removed KeyValues. Lazy VDFs are parsed, so this may throw.
+	template <class Predicate>
+	std::size_t erase_if(Predicate pred, std::vector<KeyValue> * removed = nullptr)
+	{
+		materialize();
+		// Kept KeyValues are swapped to the front, so the removed ones end up behind them.
+		auto write = data.begin();
+		for (auto read = data.begin(); read != data.end(); ++read)
+		{
+			if (pred(*read))
+			{ continue; }
+			if (write != read)
+			{ std::swap(*write, *read); }
+			++write;
+		}
+		std::size_t count = static_cast<std::size_t>(data.end() - write);
+		if (removed != nullptr)
+		{ removed->insert(removed->end(), std::make_move_iterator(write), std::make_move_iterator(data.end())); }
+		data.erase(write, data.end());
+		return count;
+	}
+
+	// Same as `erase_if()`, but keeps the KeyValues for which `pred(kv)` returns `true` and removes all others.
+	template <class Predicate>
+	std::size_t retain(Predicate pred, std::vector<KeyValue> * removed = nullptr)
+	{
+		return erase_if([&pred](KeyValue & kv) { return !pred(kv); }, removed);
+	}
+
+	// Returns the number of KeyValues in this VDF, including all nested VDFs.
+	// Lazy VDFs are parsed, so this may throw.
+	[[nodiscard]] std::size_t count_recursive() const;
+
+	// Returns a hash of this VDF, including everything inside of it. The order of KeyValues doesn't matter.
+	// KeyValues with keys listed in `ignore_keys` are left out, so VDFs that are equal according to `compare()` with
+	// `ignore_order` have equal hashes. Different VDFs only have equal hashes by (very unlikely) accident.
+	// If `cache` isn't nullptr, the hashes of all nested VDFs are stored in it, and looked up there before calculating them again.
+	// Lazy VDFs are parsed, so this may throw.
+	[[nodiscard]] std::uint64_t hash(
+			const std::unordered_set<std::string> & ignore_keys,
+			std::unordered_map<const VDF *, std::uint64_t> * cache) const;
+
 	// Returns `true` if `a` and `b` are equal, meaning they contain the same list of keys with the same values, all in the same order.
 	// Keys listed in `ignore_keys` are ignored.
 	// If `ignore_order` is `true`, the order of keys is ignored.
+	// Lazy VDFs are parsed as far as needed, so this may throw.
 	[[nodiscard]] static bool compare(
 			const VDF & a,
 			const VDF & b,
 			const std::unordered_set<std::string> & ignore_keys,
-			bool ignore_order) noexcept;
+			bool ignore_order);
 
 	class TokenizationException : public std::runtime_error
 	{
@@ -118,25 +233,137 @@ public:  // basic class API //
 		using std::runtime_error::runtime_error; // use parent constructor
 	};
 
+	// Parsing errors also print every token that was read so far to `std::cerr`, which helps with finding the problem in a VDF.
+	// Set this to `false` to keep errors quiet, for example in a library that must not write to the console of its host.
+	// Only affects the current thread.
+	static inline thread_local bool dump_parse_errors = true;
+
+	// Decides whether a block is kept while it is being read, as soon as its opening brace is found. `parents` are the keys of
+	// the blocks around it, outermost first. Blocks that aren't kept are skipped without ever being parsed, like lazy blocks.
+	using BlockFilter = std::function<bool(const std::vector<std::string> & parents, const std::string & key)>;
+
 private:  // Parsing/Serializing //
 
+	// Position of a block's content in the source text, not including the braces.
+	struct SourceRange
+	{
+		std::size_t begin, end;
+	};
+
 	struct Token
 	{
-		enum {Undefined, String, Comment, OpenBrace, CloseBrace, End} type = Undefined;
-		std::variant<std::string, int> data = -985959875;
+		// `Block` is only created by lazy tokenization and stands for a whole unparsed block, braces included.
+		enum {Undefined, String, Comment, OpenBrace, CloseBrace, Block, End} type = Undefined;
+		std::variant<std::string, int, SourceRange> data = -985959875;
 	};
 
 	friend std::ostream & operator<<(std::ostream & os, const Token & t);
 
-	// The first step in parsing a string representation of a VDF.
-	static std::vector<Token> tokenize(const std::string & vdfstring);
+	// Turns text into tokens. The text can be handed over in chunks of any size, even if that cuts a token in half.
+	// Everything needed to continue in the next chunk is stored in here.
+	class Tokenizer
+	{
+	public:
+		// If `lazy` is `true`, nested blocks are skipped and turned into a single `Block` token each.
+		// `position` is the position of the first character of the first chunk in the whole text, used for `Block` tokens.
+		// If `filter` is set, blocks that it doesn't keep are skipped without a token, and the tokens of their keys are removed again.
+		Tokenizer(bool lazy, std::size_t position, BlockFilter filter = nullptr)
+		: lazy(lazy)
+		, position(position)
+		, filter(std::move(filter))
+		{}
+
+		// Tokenizes the next chunk of text. Every finished token is added to `tokens`.
+		// Throws if the input is invalid.
+		void feed(const char * chunk, std::size_t size, std::vector<Token> & tokens);
+
+		// Tells the tokenizer that there are no more chunks. Finishes the last token and adds the `End` token.
+		// Throws if a string or a brace is left open.
+		void finish(std::vector<Token> & tokens);
+
+	private:
+		// What the last character of the last chunk was part of.
+		enum class State {Between, Quoted, Bare, Slash, Comment} state = State::Between;
+		// Characters of the unfinished String or Comment token.
+		std::string pending;
+		bool lazy;
+		std::size_t position;
+		int brace_depth = 0;
+		// Brace depth inside of a block that is being skipped. Zero if nothing is being skipped.
+		int skip_depth = 0;
+		std::size_t block_begin = 0;
+		// `true` if the block that is being skipped was thrown away by `filter`, instead of becoming a `Block` token.
+		bool discarding = false;
+		BlockFilter filter;
+		// Keys of the blocks that the next token is in, outermost first. Only used by `filter`.
+		std::vector<std::string> block_keys;
+
+		// Adds `pending` as a token of the given type and clears it.
+		void emit(std::vector<Token> & tokens, decltype(Token::type) type);
+
+		void throw_error(const std::vector<Token> & tokens, const char * what) const;
+	};
+
+	// The first step in parsing a string representation of a VDF. Only the characters in the range [`begin`, `end`) are read.
+	// If `lazy` is `true`, nested blocks are skipped and turned into a single `Block` token each.
+	static std::vector<Token> tokenize(const std::string & vdfstring, std::size_t begin, std::size_t end, bool lazy);
 
 	// The second step in parsing a string representation of a VDF. This function recursivly calls itself, so it can't be merged with `tokenize()`.
+	// Only the tokens in the range [`begin`, `end`) are parsed. Their strings are moved into the result, so they are empty afterwards.
+	// `Block` tokens become lazy VDFs that point into `source`.
 	// Throws if the input is invalid.
-	static VDF parse_tokens(const std::vector<Token> & tokens, int depth);
+	static VDF parse_tokens(std::vector<Token> & tokens, std::size_t begin, std::size_t end, int depth, const std::shared_ptr<const std::string> & source);
+
+	// Parses all tokens. The tokens are used up in the process.
+	// Throws if the input is invalid.
+	static VDF parse_tokens(std::vector<Token> && tokens);
+
+	// Parses the source text of a lazy VDF and forgets about the source afterwards.
+	void parse_source() const;
+
+	// Reads the whole file at the specified path into a string.
+	static std::string read_file(const std::string & filepath);
+
+	// Serialize this VDF into a stream. The result can be directly fed into a file.
+	// Nested VDFs that are still lazy are copied from their source text as they are.
+	void serialize(std::ostream & os, int depth) const;
 
-	// Serialize this VDF into a string. The result can be directly fed into a file.
-	std::string serialize(int depth);
+	// Serialize a single KeyValue into a stream. `tabs` must be `depth` tab characters.
+	static void serialize(std::ostream & os, const KeyValue & kv, const std::string & tabs, int depth);
+
+public:  // Parsing in chunks //
+
+	// Parses text that is handed over in chunks of any size, for example while it is being read from a pipe.
+	// Every KeyValue at the outermost level is handed to a callback as soon as it is complete.
+	// Only the tokens of the unfinished KeyValue are kept in memory.
+	class StreamParser
+	{
+	public:
+		// `on_key_value` is called for every KeyValue at the outermost level, in the same order as in the text.
+		// If `filter` is set, blocks that it doesn't keep are thrown away, together with their keys.
+		explicit StreamParser(std::function<void(KeyValue &&)> on_key_value, BlockFilter filter = nullptr);
+
+		// Parses the next chunk of text. May call `on_key_value` any number of times.
+		// Throws if the input is invalid.
+		void feed(const char * chunk, std::size_t size);
+
+		// Tells the parser that there are no more chunks.
+		// Throws if the input ends in the middle of a KeyValue.
+		void finish();
+
+	private:
+		Tokenizer tokenizer;
+		// Tokens of the unfinished KeyValue.
+		std::vector<Token> tokens;
+		// Tokens before this index have already been looked at by `flush()`.
+		std::size_t scanned = 0;
+		int depth = 0;
+		int strings_at_top = 0;
+		std::function<void(KeyValue &&)> on_key_value;
+
+		// Parses all complete KeyValues and hands them to `on_key_value`.
+		void flush();
+	};
 
 public:  // API for Parsing/Serializing //
 
@@ -144,16 +371,36 @@ public:  // API for Parsing/Serializing //
 	// May throw exceptions. (File reading errors or malformed VDF text)
 	static VDF parse_from_string(const std::string & vdfstring);
 
+	// Same as above, but takes over the string. The text is freed as soon as it has been tokenized, before the VDF is built,
+	// so the text and the finished VDF are never in memory at the same time.
+	static VDF parse_from_string(std::string && vdfstring);
+
 	// Reads the file at the specified path and turns it into a new VDF object.
 	// May throw exceptions. (Malformed VDF text)
 	static VDF parse_from_filepath(const std::string & filepath);
 
+	// Reads a string and turns it into a new VDF object, but only the outermost level is parsed right away.
+	// Every nested VDF is parsed when it is accessed for the first time. Until then, it only remembers where it is in the text.
+	// Nested VDFs that are never accessed are written back exactly as they were in the text.
+	// May throw exceptions. (Malformed VDF text, also later when a nested VDF is accessed)
+	static VDF parse_from_string_lazy(std::string vdfstring);
+
+	// Reads the file at the specified path and turns it into a new VDF object. See `parse_from_string_lazy()`.
+	// May throw exceptions. (File reading errors or malformed VDF text)
+	static VDF parse_from_filepath_lazy(const std::string & filepath);
+
 	// Writes this VDF object as a human readable string.
-	std::string serialize_to_string();
+	std::string serialize_to_string() const;
+
+	// Writes this VDF object to a stream in human readable form.
+	void serialize_to_stream(std::ostream & os) const;
+
+	// Writes a single KeyValue to a stream in human readable form, the same way it would look at the outermost level of a VDF.
+	static void serialize_to_stream(std::ostream & os, const KeyValue & kv);
 
 	// Writes this VDF object to a human readable file.
 	// May throw exceptions. (File writing/creation errors)
-	void serialize_to_filepath(const std::string & filepath);
+	void serialize_to_filepath(const std::string & filepath) const;
 
 private:  // misc //
 
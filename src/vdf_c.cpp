@@ -0,0 +1,315 @@
+#include "vdf_c.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "vdf.hpp"
+#include "profile.hpp"
+#include "extract.hpp"
+
+
+struct vdf_document
+{
+	VDF vdf;
+};
+
+struct vdf_profile
+{
+	Profile profile;
+};
+
+
+// Description of the last error, per thread, so that callers on different threads don't see each other's errors.
+static thread_local std::string last_error;
+
+// Runs `f` and turns any exception into `fail` and an error message.
+// Errors are only reported through `vdf_last_error()`, never printed to the console of the host program.
+template <class F, class R>
+static auto guard(F f, R fail) noexcept -> decltype(f())
+{
+	// A C++ host program may call these on its own threads, so its setting comes back afterwards.
+	struct QuietParseErrors
+	{
+		bool old_value = VDF::dump_parse_errors;
+		QuietParseErrors() { VDF::dump_parse_errors = false; }
+		~QuietParseErrors() { VDF::dump_parse_errors = old_value; }
+	} quiet;
+	try
+	{
+		return f();
+	}
+	catch (const std::exception & e)
+	{
+		last_error = e.what();
+	}
+	catch (const char * text)
+	{
+		last_error = text;
+	}
+	catch (...)
+	{
+		last_error = "Unknown error!";
+	}
+	return fail;
+}
+
+
+// One key of a path, and which of the KeyValues with that key is meant.
+struct PathKey
+{
+	std::string key;
+	std::size_t index = 0;
+};
+
+// Splits a path like "entity[3]/classname" into its keys.
+static std::vector<PathKey> parse_path(const char * path)
+{
+	using namespace std;
+	if (path == nullptr || *path == '\0')
+	{ throw runtime_error("Empty path!"); }
+
+	vector<PathKey> keys;
+	const string text = path;
+	size_t begin = 0;
+	while (begin <= text.size())
+	{
+		size_t end = text.find('/', begin);
+		if (end == string::npos)
+		{ end = text.size(); }
+		string part = text.substr(begin, end - begin);
+
+		PathKey path_key;
+		size_t bracket = part.find('[');
+		if (bracket != string::npos && !part.empty() && part.back() == ']')
+		{
+			const string index_text = part.substr(bracket + 1, part.size() - bracket - 2);
+			// stoul() would also take things like "-1" or "3x".
+			bool valid = !index_text.empty() && index_text.find_first_not_of("0123456789") == string::npos;
+			try
+			{
+				if (valid)
+				{ path_key.index = stoul(index_text); }
+			}
+			catch (const out_of_range &)
+			{ valid = false; }
+			if (!valid)
+			{ throw runtime_error("Invalid index in path \"" + text + "\"!"); }
+			part.resize(bracket);
+		}
+		if (part.empty())
+		{ throw runtime_error("Path \"" + text + "\" contains an empty key!"); }
+		path_key.key = move(part);
+		keys.push_back(move(path_key));
+		begin = end + 1;
+	}
+	return keys;
+}
+
+// Returns the `index`th KeyValue with matching `key`, or nullptr if there aren't that many.
+static VDF::KeyValue * find_nth(VDF & vdf, const PathKey & path_key)
+{
+	std::size_t count = 0;
+	for (VDF::KeyValue & kv : vdf)
+	{
+		if (kv.key == path_key.key && count++ == path_key.index)
+		{ return &kv; }
+	}
+	return nullptr;
+}
+
+// Read-only version of the function above.
+static const VDF::KeyValue * find_nth(const VDF & vdf, const PathKey & path_key)
+{
+	std::size_t count = 0;
+	for (const VDF::KeyValue & kv : vdf)
+	{
+		if (kv.key == path_key.key && count++ == path_key.index)
+		{ return &kv; }
+	}
+	return nullptr;
+}
+
+// Follows every key of the path except the last one. Returns nullptr if one of them doesn't exist or isn't a block.
+static const VDF * find_parent(const VDF & root, const std::vector<PathKey> & keys)
+{
+	using namespace std;
+	const VDF * vdf = &root;
+	for (size_t i = 0; i+1 < keys.size(); ++i)
+	{
+		const VDF::KeyValue * kv = find_nth(*vdf, keys[i]);
+		if (kv == nullptr || holds_alternative<string>(kv->val))
+		{ return nullptr; }
+		vdf = &kv->get_vdf();
+	}
+	return vdf;
+}
+
+// Editable version of the function above. Every block on the way is made safe to edit. (See `KeyValue::edit_vdf()`)
+// Throws if a key doesn't exist or isn't a block.
+static VDF & edit_parent(VDF & root, const std::vector<PathKey> & keys)
+{
+	using namespace std;
+	VDF * vdf = &root;
+	for (size_t i = 0; i+1 < keys.size(); ++i)
+	{
+		VDF::KeyValue * kv = find_nth(*vdf, keys[i]);
+		if (kv == nullptr || holds_alternative<string>(kv->val))
+		{ throw runtime_error("\"" + keys[i].key + "\" doesn't exist or isn't a block!"); }
+		vdf = &kv->edit_vdf();
+	}
+	return *vdf;
+}
+
+
+extern "C" {
+
+const char * vdf_last_error(void)
+{
+	return last_error.c_str();
+}
+
+vdf_document * vdf_parse(const char * text, size_t size, int lazy)
+{
+	return guard([&]() -> vdf_document *
+	{
+		std::string vdfstring (text, size);
+		if (lazy)
+		{ return new vdf_document{VDF::parse_from_string_lazy(std::move(vdfstring))}; }
+		return new vdf_document{VDF::parse_from_string(std::move(vdfstring))};
+	}, static_cast<vdf_document *>(nullptr));
+}
+
+void vdf_free(vdf_document * doc)
+{
+	delete doc;
+}
+
+char * vdf_serialize(const vdf_document * doc, size_t * size)
+{
+	return guard([&]() -> char *
+	{
+		std::string text = doc->vdf.serialize_to_string();
+		char * buffer = static_cast<char *>(std::malloc(text.size() + 1));
+		if (buffer == nullptr)
+		{ throw std::bad_alloc(); }
+		std::memcpy(buffer, text.c_str(), text.size() + 1);
+		if (size != nullptr)
+		{ *size = text.size(); }
+		return buffer;
+	}, static_cast<char *>(nullptr));
+}
+
+void vdf_free_buffer(char * buffer)
+{
+	std::free(buffer);
+}
+
+size_t vdf_count(const vdf_document * doc, const char * path)
+{
+	return guard([&]() -> size_t
+	{
+		auto keys = parse_path(path);
+		const VDF * parent = find_parent(doc->vdf, keys);
+		if (parent == nullptr)
+		{ return 0; }
+		size_t count = 0;
+		for (const VDF::KeyValue & kv : *parent)
+		{
+			if (kv.key == keys.back().key)
+			{ count += 1; }
+		}
+		return count;
+	}, static_cast<size_t>(0));
+}
+
+const char * vdf_get_string(const vdf_document * doc, const char * path)
+{
+	return guard([&]() -> const char *
+	{
+		auto keys = parse_path(path);
+		const VDF * parent = find_parent(doc->vdf, keys);
+		if (parent == nullptr)
+		{ return nullptr; }
+		const VDF::KeyValue * kv = find_nth(*parent, keys.back());
+		if (kv == nullptr || !std::holds_alternative<std::string>(kv->val))
+		{ return nullptr; }
+		return std::get<std::string>(kv->val).c_str();
+	}, static_cast<const char *>(nullptr));
+}
+
+int vdf_set_string(vdf_document * doc, const char * path, const char * value)
+{
+	return guard([&]() -> int
+	{
+		if (value == nullptr)
+		{ throw std::runtime_error("The value is NULL!"); }
+		auto keys = parse_path(path);
+		VDF & parent = edit_parent(doc->vdf, keys);
+		VDF::KeyValue * kv = find_nth(parent, keys.back());
+		if (kv == nullptr)
+		{
+			parent.emplace_back(keys.back().key, std::string(value));
+		}
+		else
+		{
+			if (!std::holds_alternative<std::string>(kv->val))
+			{ throw std::runtime_error("\"" + keys.back().key + "\" is a block, not a string!"); }
+			kv->val = std::string(value);
+		}
+		return 0;
+	}, 1);
+}
+
+int vdf_remove(vdf_document * doc, const char * path)
+{
+	return guard([&]() -> int
+	{
+		auto keys = parse_path(path);
+		VDF & parent = edit_parent(doc->vdf, keys);
+		VDF::KeyValue * kv = find_nth(parent, keys.back());
+		if (kv != nullptr)
+		{ parent.erase_if([kv](const VDF::KeyValue & other) { return &other == kv; }); }
+		return 0;
+	}, 1);
+}
+
+vdf_profile * vdf_profile_builtin(const char * name)
+{
+	return guard([&]() -> vdf_profile *
+	{
+		const std::string profile_name = (name == nullptr) ? "" : name;
+		if (profile_name == "environment")
+		{ return new vdf_profile{Profile::environment()}; }
+		if (profile_name == "lighting")
+		{ return new vdf_profile{Profile::lighting()}; }
+		if (profile_name == "entities")
+		{ return new vdf_profile{Profile::entities()}; }
+		throw std::runtime_error("There is no built-in profile called \"" + profile_name + "\"!");
+	}, static_cast<vdf_profile *>(nullptr));
+}
+
+vdf_profile * vdf_profile_parse(const char * text, size_t size)
+{
+	return guard([&]() -> vdf_profile *
+	{
+		return new vdf_profile{Profile::load(VDF::parse_from_string(std::string(text, size)))};
+	}, static_cast<vdf_profile *>(nullptr));
+}
+
+void vdf_profile_free(vdf_profile * profile)
+{
+	delete profile;
+}
+
+vdf_document * vdf_extract(const vdf_document * doc, const vdf_profile * profile)
+{
+	return guard([&]() -> vdf_document *
+	{
+		return new vdf_document{extract(doc->vdf, profile->profile)};
+	}, static_cast<vdf_document *>(nullptr));
+}
+
+}
@@ -0,0 +1,76 @@
+/*
+ * C interface to the VDF parser and the extraction, for use from other programs and languages (for example Python's ctypes).
+ * Link against "bin/libvdf.a" or "bin/libvdf.so", which are built by the makefile.
+ *
+ * Functions that can fail return `NULL` or a non-zero value. `vdf_last_error()` then describes what went wrong.
+ * No function throws C++ exceptions through this interface.
+ *
+ * Paths select KeyValues inside of a document. They are keys separated by '/', and every key may be followed by an index
+ * in square brackets to select one of several KeyValues with the same key. Without an index, the first one is used.
+ * For example, "world/skyname" or "entity[3]/classname".
+ */
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A parsed VDF. */
+typedef struct vdf_document vdf_document;
+
+/* Decides what an extraction keeps. */
+typedef struct vdf_profile vdf_profile;
+
+/* Returns a description of the last error on this thread. The text stays valid until the next failing call. */
+const char * vdf_last_error(void);
+
+/* Parses `size` bytes of VDF text. If `lazy` is non-zero, nested blocks are only parsed when they are accessed.
+ * Returns NULL on failure. Free the result with `vdf_free()`. */
+vdf_document * vdf_parse(const char * text, size_t size, int lazy);
+
+/* Frees a document. Does nothing if `doc` is NULL. */
+void vdf_free(vdf_document * doc);
+
+/* Writes a document as VDF text. The size of the text is stored in `size`, if it isn't NULL.
+ * Returns NULL on failure. Free the result with `vdf_free_buffer()`. */
+char * vdf_serialize(const vdf_document * doc, size_t * size);
+
+/* Frees a buffer returned by `vdf_serialize()`. Does nothing if `buffer` is NULL. */
+void vdf_free_buffer(char * buffer);
+
+/* Returns the number of KeyValues that could be selected by the last key of `path` with an index, for example the number
+ * of "entity" blocks for the path "entity". Returns 0 if nothing matches. */
+size_t vdf_count(const vdf_document * doc, const char * path);
+
+/* Returns the string value at `path`, or NULL if there is none (or it's a block).
+ * The text stays valid until `doc` is edited or freed. */
+const char * vdf_get_string(const vdf_document * doc, const char * path);
+
+/* Sets the string value at `path`. If the last key doesn't exist yet, it is added at the end of its block.
+ * Returns 0 on success, and fails if `value` is NULL. */
+int vdf_set_string(vdf_document * doc, const char * path, const char * value);
+
+/* Removes the KeyValue at `path`. Returns 0 on success, also if there was nothing to remove. */
+int vdf_remove(vdf_document * doc, const char * path);
+
+/* Returns one of the built-in profiles: "environment", "lighting" or "entities".
+ * Returns NULL on failure. Free the result with `vdf_profile_free()`. */
+vdf_profile * vdf_profile_builtin(const char * name);
+
+/* Reads a profile from `size` bytes of VDF text, in the same format as a profile file.
+ * Returns NULL on failure. Free the result with `vdf_profile_free()`. */
+vdf_profile * vdf_profile_parse(const char * text, size_t size);
+
+/* Frees a profile. Does nothing if `profile` is NULL. */
+void vdf_profile_free(vdf_profile * profile);
+
+/* Creates a new document by extracting `doc` with `profile`. `doc` isn't changed, and the two documents can be edited
+ * and freed independently of each other. Unchanged parts are shared between them though, so they must not be used
+ * from different threads at the same time. Returns NULL on failure. Free the result with `vdf_free()`. */
+vdf_document * vdf_extract(const vdf_document * doc, const vdf_profile * profile);
+
+#ifdef __cplusplus
+}
+#endif
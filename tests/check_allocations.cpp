@@ -0,0 +1,49 @@
+// Parses a VMF and fails if the parser makes more heap allocations per KeyValue than it should.
+// Run it with "make COUNT_ALLOCATIONS=1 check". (After "make clean", so that everything is built with the counter.)
+// Usage: check_allocations <vmf path> <most allocations per KeyValue>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "vdf.hpp"
+#include "utility.hpp"
+
+
+int main(int argc, char* argv[])
+{
+	using namespace std;
+	if (argc != 3)
+	{
+		cerr << "Usage: check_allocations <vmf path> <most allocations per KeyValue>" << endl;
+		return 2;
+	}
+	const double limit = stod(argv[2]);
+
+	ifstream infile {argv[1]};
+	stringstream buffer;
+	buffer << infile.rdbuf();
+	string text = buffer.str();
+
+	size_t allocations_before = allocation_count();
+	VDF vdf = VDF::parse_from_string(move(text));
+	size_t allocations = allocation_count() - allocations_before;
+	size_t kv_count = vdf.count_recursive();
+
+	if (allocations == 0)
+	{
+		cerr << "[CHECK] No allocations were counted. Run \"make clean\" and then \"make COUNT_ALLOCATIONS=1 check\"." << endl;
+		return 1;
+	}
+
+	double per_kv = kv_count ? double(allocations) / kv_count : 0.0;
+	cout << "[CHECK] Parsing made " << allocations << " allocations for " << kv_count << " KeyValues (" << per_kv << " per KeyValue, at most " << limit << " allowed)" << endl;
+	if (per_kv > limit)
+	{
+		cerr << "[CHECK] FAILED: The parser makes more allocations than it used to!" << endl;
+		return 1;
+	}
+	cout << "[CHECK] Allocation check passed." << endl;
+	return 0;
+}
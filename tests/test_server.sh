@@ -0,0 +1,115 @@
+#!/bin/sh
+# Tests the extraction server: starts "serve", runs jobs from several clients at the same time, compares their outputs with
+# the output of the normal program, and checks "stats" and "shutdown". Run it with "make test-server".
+# Usage: tests/test_server.sh <path of the program>
+
+MAIN="$1"
+if [ -z "$MAIN" ]; then
+	echo "Usage: $0 <path of the program>"
+	exit 2
+fi
+MAIN="$(cd "$(dirname "$MAIN")" && pwd)/$(basename "$MAIN")"
+TESTS="$(cd "$(dirname "$0")" && pwd)"
+WORK="$(mktemp -d)"
+SOCKET="$WORK/server.sock"
+JOBS=8
+SERVER_PID=""
+IDLE_PID=""
+
+fail()
+{
+	echo "[TEST] FAILED: $1"
+	[ -n "$IDLE_PID" ] && kill "$IDLE_PID" 2>/dev/null
+	[ -n "$SERVER_PID" ] && kill "$SERVER_PID" 2>/dev/null
+	echo "[TEST] Server output:"
+	cat "$WORK/server.log" 2>/dev/null
+	rm -rf "$WORK"
+	exit 1
+}
+
+# Expected results, made by the normal program.
+cp "$TESTS/sample.vmf" "$WORK/expected.vmf"
+"$MAIN" "$WORK/expected.vmf" --lighting > /dev/null || fail "the program itself failed"
+
+"$MAIN" serve "$SOCKET" 2 > "$WORK/server.log" 2>&1 &
+SERVER_PID=$!
+i=0
+while [ ! -S "$SOCKET" ]; do
+	i=$((i+1))
+	[ $i -gt 50 ] && fail "the server didn't create its socket"
+	sleep 0.1
+done
+
+# A second server must not take over the socket of a running one. It should give up right away.
+"$MAIN" serve "$SOCKET" 1 > /dev/null 2>&1 &
+SECOND_PID=$!
+sleep 0.5
+if kill -0 "$SECOND_PID" 2>/dev/null; then
+	kill "$SECOND_PID"
+	fail "a second server started on the same socket"
+fi
+
+# A client that connects and then does nothing must not hold up other jobs or the shutdown.
+if command -v python3 > /dev/null; then
+	python3 -c "import socket, sys, time; s = socket.socket(socket.AF_UNIX); s.connect(sys.argv[1]); open(sys.argv[2], 'w').close(); time.sleep(30)" "$SOCKET" "$WORK/idle.ready" &
+	IDLE_PID=$!
+	# Only go on once it is really connected, or the shutdown below wouldn't test anything.
+	i=0
+	while [ ! -e "$WORK/idle.ready" ]; do
+		i=$((i+1))
+		[ $i -gt 50 ] && fail "the idle client couldn't connect"
+		sleep 0.1
+	done
+else
+	echo "[TEST] python3 not found, skipping the idle client."
+fi
+
+# Several clients at the same time, half of them with a profile file.
+CLIENT_PIDS=""
+n=1
+while [ $n -le $JOBS ]; do
+	if [ $((n % 2)) -eq 0 ]; then
+		"$MAIN" client "$SOCKET" "$TESTS/sample.vmf" "$WORK/out$n.vmf" "$TESTS/../profiles/environment.vdf" > "$WORK/client$n.log" 2>&1 &
+	else
+		"$MAIN" client "$SOCKET" "$TESTS/sample.vmf" "$WORK/out$n.vmf" > "$WORK/client$n.log" 2>&1 &
+	fi
+	CLIENT_PIDS="$CLIENT_PIDS $!"
+	n=$((n+1))
+done
+wait_failed=0
+for pid in $CLIENT_PIDS; do
+	wait "$pid" || wait_failed=1
+done
+[ $wait_failed -eq 0 ] || fail "a client job failed"
+
+n=1
+while [ $n -le $JOBS ]; do
+	cmp -s "$WORK/expected.vmf.env.vmf" "$WORK/out$n.vmf" || fail "output $n is different from the program's output"
+	n=$((n+1))
+done
+
+# A broken VMF must be reported, and must not leave an output behind.
+head -c 2000 "$TESTS/sample.vmf" > "$WORK/broken.vmf"
+"$MAIN" client "$SOCKET" "$WORK/broken.vmf" "$WORK/broken.out.vmf" > /dev/null 2>&1 && fail "a broken VMF was accepted"
+[ -e "$WORK/broken.out.vmf" ] && fail "a broken VMF left an output behind"
+ls "$WORK" | grep -q "\.tmp$" && fail "a broken VMF left a temporary file behind"
+
+STATS="$("$MAIN" client "$SOCKET" stats 2>&1)"
+echo "$STATS" | grep -q "\"jobs_done\" \"$JOBS\"" || fail "unexpected stats: $STATS"
+echo "$STATS" | grep -q "\"jobs_failed\" \"1\"" || fail "unexpected stats: $STATS"
+
+# The server must stop right away, even with the idle client still connected.
+"$MAIN" client "$SOCKET" shutdown > /dev/null 2>&1 || fail "the shutdown request failed"
+i=0
+while kill -0 "$SERVER_PID" 2>/dev/null; do
+	i=$((i+1))
+	[ $i -gt 50 ] && fail "the server didn't stop within 5 seconds"
+	sleep 0.1
+done
+wait "$SERVER_PID" || fail "the server exited with an error"
+SERVER_PID=""
+[ -e "$SOCKET" ] && fail "the server didn't remove its socket"
+
+[ -n "$IDLE_PID" ] && kill "$IDLE_PID" 2>/dev/null
+rm -rf "$WORK"
+echo "[TEST] Server test passed."